@@ -0,0 +1,33 @@
+#include "graphics.h"
+#include <cmath>
+#include <iostream>
+
+
+void animation()
+{
+    using namespace graphics2;
+
+    auto width = 600;
+    auto height = 400;
+    image_surface_t surface(Format::FORMAT_ARGB32, width, height);
+
+    std::string filename = "animation.png";
+    apng_writer_t writer(filename, 50);
+
+    surface.fill(color_t(0.86, 0.85, 0.47));
+    auto pen = pen_t(color_t(0, 0, 0, 0.7), 4);
+    for (int frame = 0; frame < 60; ++frame)
+    {
+        // only the new segment changes, so only its bounding box is encoded
+        auto x = width * frame / 60.0;
+        surface.stroke(
+            pen,
+            line_t(
+                pos_t(x, height / 2.0 + height / 4.0 * std::sin(x / 50.0)),
+                pos_t(x + width / 60.0, height / 2.0 + height / 4.0 * std::sin((x + width / 60.0) / 50.0))));
+        writer.add_frame(surface);
+    }
+    writer.finish();
+
+    std::cout << "Wrote animated png file \"" << filename << "\"" << std::endl;
+}
@@ -0,0 +1,468 @@
+#include "graphics.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+
+namespace graphics2 {
+
+
+namespace detail {
+
+
+    class crc32_t
+    {
+    public:
+        crc32_t()
+        {
+            for (std::uint32_t n = 0; n < _table.size(); ++n)
+            {
+                std::uint32_t c = n;
+                for (int k = 0; k < 8; ++k)
+                {
+                    c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                }
+                _table[n] = c;
+            }
+        }
+
+        std::uint32_t operator()(std::uint32_t crc, const unsigned char* data, std::size_t size) const
+        {
+            crc = ~crc;
+            for (std::size_t i = 0; i < size; ++i)
+            {
+                crc = _table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+            }
+            return ~crc;
+        }
+
+    private:
+        std::array<std::uint32_t, 256> _table;
+    };
+
+
+    struct area_t
+    {
+        int x;
+        int y;
+        int width;
+        int height;
+    };
+
+
+    struct frame_t
+    {
+        std::vector<std::uint32_t> pixels;
+        unsigned delay_ms;
+    };
+
+
+    struct apng_writer_t
+    {
+        apng_writer_t(const std::string& filename, unsigned delay_ms, unsigned plays);
+        ~apng_writer_t();
+
+        void add_frame(const image_surface_t&, unsigned delay_ms);
+        void finish();
+        unsigned default_delay_ms() const { return _default_delay_ms; }
+
+    private:
+        static constexpr std::size_t max_queued = 2;
+
+        void run();
+        void encode(const frame_t&);
+        area_t changed(const frame_t&) const;
+        std::string compress(const frame_t&, const area_t&) const;
+
+        void write_chunk(const std::string& type, const std::string& data);
+        void write_frame_control(const area_t&, unsigned delay_ms);
+        void write_animation_control();
+        void rethrow();
+
+        std::string _filename;
+        std::ofstream _file;
+        unsigned _default_delay_ms;
+        unsigned _plays;
+        crc32_t _crc;
+
+        // set by the first frame
+        int _width = 0;
+        int _height = 0;
+        Format _format = Format::FORMAT_ARGB32;
+
+        // only touched by the encoder thread
+        frame_t _previous;
+        std::uint32_t _sequence = 0;
+        std::uint32_t _frames = 0;
+        std::streampos _animation_control;
+
+        std::mutex _mutex;
+        std::condition_variable _condition;
+        std::deque<frame_t> _queue;
+        bool _done = false;
+        std::exception_ptr _error;
+        std::thread _thread;
+    };
+
+
+    void append_u32(std::string& out, std::uint32_t value)
+    {
+        out += static_cast<char>(value >> 24);
+        out += static_cast<char>(value >> 16);
+        out += static_cast<char>(value >> 8);
+        out += static_cast<char>(value);
+    }
+
+
+    void append_u16(std::string& out, std::uint16_t value)
+    {
+        out += static_cast<char>(value >> 8);
+        out += static_cast<char>(value);
+    }
+
+
+    const char png_signature[] = "\x89PNG\r\n\x1a\n";
+
+
+    apng_writer_t::apng_writer_t(const std::string& filename, unsigned delay_ms, unsigned plays)
+        : _filename(filename)
+        , _file(filename, std::ios::binary | std::ios::trunc)
+        , _default_delay_ms(delay_ms)
+        , _plays(plays)
+    {
+        if (!_file)
+            throw std::runtime_error("could not open \"" + filename + "\" for writing");
+        _thread = std::thread([this] { run(); });
+    }
+
+
+    apng_writer_t::~apng_writer_t()
+    {
+        try
+        {
+            finish();
+        }
+        catch (...)
+        {
+        }
+    }
+
+
+    void apng_writer_t::add_frame(const image_surface_t& surface, unsigned delay_ms)
+    {
+        const auto format = surface.format();
+        if (format != Format::FORMAT_ARGB32 && format != Format::FORMAT_RGB24)
+            throw std::invalid_argument("apng_writer_t needs ARGB32 or RGB24 frames");
+        if (_width == 0)
+        {
+            _width = surface.width();
+            _height = surface.height();
+            _format = format;
+        }
+        else if (surface.width() != _width || surface.height() != _height || format != _format)
+        {
+            throw std::invalid_argument("apng_writer_t frames must all have the same size and format");
+        }
+
+        // the copy is what lets the caller render the next frame right away
+        frame_t frame{std::vector<std::uint32_t>(std::size_t(_width) * _height), delay_ms};
+        surface.flush();
+        const auto* data = surface.data();
+        const auto stride = surface.stride();
+        const std::uint32_t mask = format == Format::FORMAT_RGB24 ? 0x00ffffffu : 0xffffffffu;
+        for (int y = 0; y < _height; ++y)
+        {
+            const auto* row = reinterpret_cast<const std::uint32_t*>(data + std::ptrdiff_t(y) * stride);
+            auto* out = frame.pixels.data() + std::ptrdiff_t(y) * _width;
+            for (int x = 0; x < _width; ++x)
+            {
+                out[x] = row[x] & mask;
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        _condition.wait(lock, [this] { return _queue.size() < max_queued || _error; });
+        rethrow();
+        if (_done)
+            throw std::logic_error("apng_writer_t::add_frame after finish");
+        _queue.push_back(std::move(frame));
+        _condition.notify_all();
+    }
+
+
+    void apng_writer_t::finish()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _done = true;
+            _condition.notify_all();
+        }
+        if (_thread.joinable())
+            _thread.join();
+        std::lock_guard<std::mutex> lock(_mutex);
+        rethrow();
+    }
+
+
+    void apng_writer_t::rethrow()
+    {
+        if (_error)
+            std::rethrow_exception(_error);
+    }
+
+
+    void apng_writer_t::run()
+    {
+        try
+        {
+            while (true)
+            {
+                frame_t frame;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _condition.wait(lock, [this] { return !_queue.empty() || _done; });
+                    if (_queue.empty())
+                        break;
+                    frame = std::move(_queue.front());
+                    _queue.pop_front();
+                    _condition.notify_all();
+                }
+                encode(frame);
+                _previous = std::move(frame);
+            }
+            if (_frames == 0)
+            {
+                // an empty file is no png at all, leave nothing behind
+                _file.close();
+                std::remove(_filename.c_str());
+                throw std::logic_error("apng_writer_t finished without frames");
+            }
+            write_chunk("IEND", std::string());
+            write_animation_control();
+            _file.flush();
+            if (!_file)
+                throw std::runtime_error("writing animated png failed");
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _error = std::current_exception();
+            _queue.clear();
+            _condition.notify_all();
+        }
+    }
+
+
+    void apng_writer_t::encode(const frame_t& frame)
+    {
+        const bool first = _frames == 0;
+        const auto area = first ? area_t{0, 0, _width, _height} : changed(frame);
+        const auto image = compress(frame, area);
+
+        if (first)
+        {
+            std::string header;
+            append_u32(header, _width);
+            append_u32(header, _height);
+            header += static_cast<char>(8); // bit depth
+            header += static_cast<char>(_format == Format::FORMAT_ARGB32 ? 6 : 2); // RGBA or RGB
+            header += static_cast<char>(0); // deflate
+            header += static_cast<char>(0); // adaptive filtering
+            header += static_cast<char>(0); // not interlaced
+            _file.write(png_signature, 8);
+            write_chunk("IHDR", header);
+            _animation_control = _file.tellp();
+            write_animation_control();
+        }
+
+        write_frame_control(area, frame.delay_ms);
+        if (first)
+        {
+            write_chunk("IDAT", image);
+        }
+        else
+        {
+            std::string data;
+            append_u32(data, _sequence++);
+            write_chunk("fdAT", data + image);
+        }
+        ++_frames;
+    }
+
+
+    area_t apng_writer_t::changed(const frame_t& frame) const
+    {
+        int left = _width;
+        int right = -1;
+        int top = _height;
+        int bottom = -1;
+        for (int y = 0; y < _height; ++y)
+        {
+            const auto* a = frame.pixels.data() + std::ptrdiff_t(y) * _width;
+            const auto* b = _previous.pixels.data() + std::ptrdiff_t(y) * _width;
+            if (std::memcmp(a, b, sizeof(std::uint32_t) * _width) == 0)
+                continue;
+            top = std::min(top, y);
+            bottom = y;
+            int x0 = 0;
+            while (a[x0] == b[x0])
+                ++x0;
+            int x1 = _width - 1;
+            while (a[x1] == b[x1])
+                --x1;
+            left = std::min(left, x0);
+            right = std::max(right, x1);
+        }
+        // an unchanged frame still needs some pixels to carry its delay
+        if (bottom < 0)
+            return area_t{0, 0, 1, 1};
+        return area_t{left, top, right - left + 1, bottom - top + 1};
+    }
+
+
+    // png scanlines use the sub filter, which suits the flat areas of charts
+    std::string apng_writer_t::compress(const frame_t& frame, const area_t& area) const
+    {
+        const bool alpha = _format == Format::FORMAT_ARGB32;
+        const int channels = alpha ? 4 : 3;
+        const std::size_t line = 1 + std::size_t(channels) * area.width;
+        std::string raw(line * area.height, '\0');
+        for (int y = 0; y < area.height; ++y)
+        {
+            auto* out = reinterpret_cast<unsigned char*>(&raw[line * y]);
+            *out++ = 1; // PNG_FILTER_VALUE_SUB
+            const auto* in = frame.pixels.data() + std::ptrdiff_t(area.y + y) * _width + area.x;
+            unsigned char previous[4] = {0, 0, 0, 0};
+            for (int x = 0; x < area.width; ++x)
+            {
+                const std::uint32_t pixel = in[x];
+                const unsigned a = alpha ? pixel >> 24 : 255;
+                unsigned char rgba[4] = {
+                    static_cast<unsigned char>(pixel >> 16),
+                    static_cast<unsigned char>(pixel >> 8),
+                    static_cast<unsigned char>(pixel),
+                    static_cast<unsigned char>(a)};
+                // cairo stores premultiplied alpha, png does not
+                if (a != 0 && a != 255)
+                {
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        rgba[c] = static_cast<unsigned char>((rgba[c] * 255 + a / 2) / a);
+                    }
+                }
+                for (int c = 0; c < channels; ++c)
+                {
+                    *out++ = static_cast<unsigned char>(rgba[c] - previous[c]);
+                    previous[c] = rgba[c];
+                }
+            }
+        }
+
+        uLongf size = compressBound(raw.size());
+        std::string compressed(size, '\0');
+        const auto result = compress2(
+            reinterpret_cast<Bytef*>(&compressed[0]), &size,
+            reinterpret_cast<const Bytef*>(raw.data()), raw.size(),
+            Z_DEFAULT_COMPRESSION);
+        if (result != Z_OK)
+            throw std::runtime_error("compressing animated png frame failed");
+        compressed.resize(size);
+        return compressed;
+    }
+
+
+    void apng_writer_t::write_chunk(const std::string& type, const std::string& data)
+    {
+        std::string length;
+        append_u32(length, data.size());
+        auto crc = _crc(0, reinterpret_cast<const unsigned char*>(type.data()), type.size());
+        crc = _crc(crc, reinterpret_cast<const unsigned char*>(data.data()), data.size());
+        std::string checksum;
+        append_u32(checksum, crc);
+        _file << length << type << data << checksum;
+    }
+
+
+    void apng_writer_t::write_frame_control(const area_t& area, unsigned delay_ms)
+    {
+        std::string data;
+        append_u32(data, _sequence++);
+        append_u32(data, area.width);
+        append_u32(data, area.height);
+        append_u32(data, area.x);
+        append_u32(data, area.y);
+        // the delay fraction has 16 bit fields
+        append_u16(data, std::min(delay_ms, 65535u));
+        append_u16(data, 1000);
+        data += static_cast<char>(0); // APNG_DISPOSE_OP_NONE
+        data += static_cast<char>(0); // APNG_BLEND_OP_SOURCE
+        write_chunk("fcTL", data);
+    }
+
+
+    // written with a zero frame count after IHDR, and again at the end when the
+    // count is known
+    void apng_writer_t::write_animation_control()
+    {
+        const auto end = _file.tellp();
+        const bool patch = _frames > 0;
+        if (patch)
+            _file.seekp(_animation_control);
+        std::string data;
+        append_u32(data, _frames);
+        append_u32(data, _plays);
+        write_chunk("acTL", data);
+        if (patch)
+            _file.seekp(end);
+    }
+
+
+}
+
+
+apng_writer_t::apng_writer_t(const std::string& filename, unsigned delay_ms, unsigned plays)
+    : _writer(new detail::apng_writer_t(filename, delay_ms, plays))
+{
+}
+
+
+apng_writer_t::apng_writer_t(apng_writer_t&& other)
+    : _writer(std::move(other._writer))
+{}
+
+
+apng_writer_t::~apng_writer_t()
+{}
+
+
+void apng_writer_t::add_frame(const image_surface_t& surface)
+{
+    add_frame(surface, _writer->default_delay_ms());
+}
+
+
+void apng_writer_t::add_frame(const image_surface_t& surface, unsigned delay_ms)
+{
+    _writer->add_frame(surface, delay_ms);
+}
+
+
+void apng_writer_t::finish()
+{
+    _writer->finish();
+}
+
+
+}
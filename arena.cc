@@ -0,0 +1,115 @@
+#include "graphics.h"
+#include <cmath>
+#include <iostream>
+#include <memory_resource>
+
+
+namespace {
+
+    // counts what reaches the upstream resource
+    class counting_resource_t : public std::pmr::memory_resource
+    {
+    public:
+        explicit counting_resource_t(std::pmr::memory_resource* upstream)
+            : _upstream(upstream)
+        {}
+
+        std::size_t allocations() const { return _allocations; }
+
+    private:
+        void* do_allocate(std::size_t bytes, std::size_t alignment) override
+        {
+            ++_allocations;
+            return _upstream->allocate(bytes, alignment);
+        }
+
+        void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override
+        {
+            _upstream->deallocate(p, bytes, alignment);
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+        {
+            return this == &other;
+        }
+
+        std::pmr::memory_resource* _upstream;
+        std::size_t _allocations = 0;
+    };
+
+
+    void render_frame(graphics2::surface_t& surface, std::pmr::memory_resource* resource)
+    {
+        using namespace graphics2;
+        path_t grid(resource);
+        for (int i = 0; i <= 60; ++i)
+        {
+            grid += line_t(pos_t(i * 10, 0), pos_t(i * 10, 400));
+            grid += line_t(pos_t(0, i * 10), pos_t(600, i * 10));
+        }
+        surface.stroke(pen_t(color_t(0.8, 0.8, 0.8), 0.5), grid);
+
+        path_t markers(resource);
+        for (int i = 0; i < 1000; ++i)
+        {
+            markers += arc_t(pos_t(i * 0.6, 200 + 150 * std::sin(i / 50.0)), 1.5, 0, 2*M_PI);
+        }
+        surface.fill(color_t(0.2, 0.2, 0.8), markers);
+
+        surface.print(
+            font_t(
+                toy_font_face_t("Bitstream Charter", FontSlant::FONT_SLANT_NORMAL, FontWeight::FONT_WEIGHT_NORMAL),
+                color_t(0, 0, 0),
+                12,
+                resource),
+            pos_t(10, 20),
+            "frame");
+    }
+
+}
+
+
+// returns the number of failed checks
+int arena()
+{
+    using namespace graphics2;
+    image_surface_t surface(Format::FORMAT_ARGB32, 600, 400);
+
+    counting_resource_t heap(std::pmr::new_delete_resource());
+    render_frame(surface, &heap);
+
+    // one upstream allocation for the whole frame, released in one go
+    counting_resource_t upstream(std::pmr::new_delete_resource());
+    {
+        std::pmr::monotonic_buffer_resource frame(1 << 20, &upstream);
+        render_frame(surface, &frame);
+    }
+
+    std::cout << "geometry allocations per frame, heap: " << heap.allocations()
+              << ", arena: " << upstream.allocations() << std::endl;
+
+    int failures = 0;
+    if (upstream.allocations() > 1)
+    {
+        std::cout << "arena: FAILED, the frame went upstream " << upstream.allocations() << " times" << std::endl;
+        ++failures;
+    }
+
+    // a path assigned to keeps allocating from its own resource
+    counting_resource_t kept(std::pmr::new_delete_resource());
+    counting_resource_t moved(std::pmr::new_delete_resource());
+    path_t target(&kept);
+    {
+        path_t source(&moved);
+        source += line_t(pos_t(0, 0), pos_t(1, 1));
+        target = std::move(source);
+    }
+    const auto before = kept.allocations();
+    target += line_t(pos_t(1, 1), pos_t(2, 0));
+    if (target.resource() != &kept || kept.allocations() == before)
+    {
+        std::cout << "arena: FAILED, a moved path changed its resource" << std::endl;
+        ++failures;
+    }
+    return failures;
+}
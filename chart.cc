@@ -0,0 +1,48 @@
+#include "graphics.h"
+#include <cmath>
+#include <string>
+
+
+// The render client's scene, a grid, a curve, bars and labels recorded into
+// a command buffer.
+graphics2::command_buffer_t chart_scene(double width, double height)
+{
+    using namespace graphics2;
+
+    command_buffer_t scene;
+    scene.fill(color_t(1, 1, 1));
+
+    const double left = 60;
+    const double bottom = height - 40;
+    const pen_t grid(color_t(0, 0, 0, 0.15), 1);
+    for (int i = 0; i <= 10; ++i)
+    {
+        const double y = bottom - i * (bottom - 20) / 10;
+        scene.stroke(grid, line_t(pos_t(left, y), pos_t(width - 20, y)));
+    }
+
+    path_t curve;
+    const double step = (width - 20 - left) / 200;
+    const auto value = [&](int x) { return bottom - (0.5 + 0.4 * std::sin(x * 0.05)) * (bottom - 20); };
+    for (int i = 0; i < 200; ++i)
+    {
+        curve += line_t(pos_t(left + i * step, value(i)), pos_t(left + (i + 1) * step, value(i + 1)));
+    }
+    scene.stroke(pen_t(color_t(0.2, 0.4, 0.8), 2), curve);
+
+    for (int i = 0; i < 20; ++i)
+    {
+        const double bar = (bottom - 20) * (0.2 + 0.03 * i);
+        scene.fill(color_t(0.9, 0.5, 0.2, 0.6), rectangle_t(pos_t(left + 10 + i * step * 10, bottom - bar), pos_t(step * 6, bar)));
+    }
+
+    font_t font(
+        toy_font_face_t("sans-serif", FontSlant::FONT_SLANT_NORMAL, FontWeight::FONT_WEIGHT_NORMAL),
+        color_t(0.2, 0.2, 0.2),
+        12);
+    for (int i = 0; i <= 10; ++i)
+    {
+        scene.print(font, pos_t(10, bottom - i * (bottom - 20) / 10 + 4), std::to_string(i * 10) + "%");
+    }
+    return scene;
+}
@@ -1,3 +1,4 @@
+#pragma once
 //#include <cairomm/context.h>
 #include <utility>
 #include <cstdint>
@@ -7,6 +8,9 @@
 
 
 namespace graphics2 {
+// pixel layouts live in their own namespace, graphics.h already has the
+// runtime color_t
+namespace pixel {
 
 
 template<int BITS> struct uint_at_least;
@@ -57,6 +61,35 @@ private:
 };
 
 
+template<typename TYPE, typename RANGE> class value_in_range;
+
+
+// a channel a pixel layout does not store, e.g. alpha in 565; it reads as
+// fully on
+class absent_channel
+{
+public:
+    using type = std::uint8_t;
+
+    constexpr absent_channel() {}
+    explicit constexpr absent_channel(type) {}
+    template<typename...ARGS>
+    explicit constexpr absent_channel(const value_in_range<ARGS...>&) {}
+
+    constexpr type min() const { return 0; }
+    constexpr type max() const { return 1; }
+    constexpr type value() const { return max(); }
+    constexpr bool is_valid() const { return true; }
+};
+
+
+inline std::ostream& operator<<(std::ostream& os, const absent_channel&)
+{
+    os << '-';
+    return os;
+}
+
+
 template<typename TYPE, typename RANGE>
 class value_in_range: public RANGE
 {
@@ -77,6 +110,10 @@ public:
         : _value(unscaled(ovalue.scaled()))
     {}
 
+    explicit constexpr value_in_range(const absent_channel&)
+        : _value(range::max())
+    {}
+
     constexpr bool is_valid() const { return range::is_valid(value()); }
 
 private:
@@ -100,7 +137,12 @@ std::ostream& operator<<(std::ostream& os, const value_in_range<Args...>& value_
 using channel = value_in_range<double, numeric_range_t<std::int8_t, 0, 1>>;
 
 template<int BITS>
-using channel_bits = value_in_range<uint_at_least_t<BITS>, numeric_range_t<uint_at_least_t<BITS>, 0, (1<<BITS)-1>>;
+struct channel_bits_type { using type = value_in_range<uint_at_least_t<BITS>, numeric_range_t<uint_at_least_t<BITS>, 0, (1<<BITS)-1>>; };
+template<>
+struct channel_bits_type<0> { using type = absent_channel; };
+
+template<int BITS>
+using channel_bits = typename channel_bits_type<BITS>::type;
 
 
 template<typename RCHANNEL, typename GCHANNEL, typename BCHANNEL, typename ALPHACHANNEL>
@@ -283,53 +325,60 @@ bool Paint(Surface, FillPattern, ClosedPath);
 */
 
 
+}
 }
 
 
-void test_at_least()
+inline void test_at_least()
 {
-    static_assert(std::is_same<void, graphics2::uint_at_least_t<0>>::value, "Zero bit unsigned int should be void");
-    static_assert(std::is_same<std::uint8_t, graphics2::uint_at_least_t<1>>::value, "Zero bit unsigned int should be void");
-    static_assert(std::is_same<std::uint8_t, graphics2::uint_at_least_t<8>>::value, "Zero bit unsigned int should be void");
-    static_assert(std::is_same<std::uint16_t, graphics2::uint_at_least_t<9>>::value, "Zero bit unsigned int should be void");
-    static_assert(std::is_same<std::uint16_t, graphics2::uint_at_least_t<16>>::value, "Zero bit unsigned int should be void");
-    static_assert(std::is_same<std::uint32_t, graphics2::uint_at_least_t<17>>::value, "Zero bit unsigned int should be void");
-    static_assert(std::is_same<std::uint32_t, graphics2::uint_at_least_t<32>>::value, "Zero bit unsigned int should be void");
-    static_assert(std::is_same<std::uint64_t, graphics2::uint_at_least_t<33>>::value, "Zero bit unsigned int should be void");
-    static_assert(std::is_same<std::uint64_t, graphics2::uint_at_least_t<64>>::value, "Zero bit unsigned int should be void");
-//    static_assert(std::is_same<std::uint8_t, graphics2::uint_at_least_t<65>>::value, "Zero bit unsigned int should be void");
+    static_assert(std::is_same<void, graphics2::pixel::uint_at_least_t<0>>::value, "Zero bit unsigned int should be void");
+    static_assert(std::is_same<std::uint8_t, graphics2::pixel::uint_at_least_t<1>>::value, "Zero bit unsigned int should be void");
+    static_assert(std::is_same<std::uint8_t, graphics2::pixel::uint_at_least_t<8>>::value, "Zero bit unsigned int should be void");
+    static_assert(std::is_same<std::uint16_t, graphics2::pixel::uint_at_least_t<9>>::value, "Zero bit unsigned int should be void");
+    static_assert(std::is_same<std::uint16_t, graphics2::pixel::uint_at_least_t<16>>::value, "Zero bit unsigned int should be void");
+    static_assert(std::is_same<std::uint32_t, graphics2::pixel::uint_at_least_t<17>>::value, "Zero bit unsigned int should be void");
+    static_assert(std::is_same<std::uint32_t, graphics2::pixel::uint_at_least_t<32>>::value, "Zero bit unsigned int should be void");
+    static_assert(std::is_same<std::uint64_t, graphics2::pixel::uint_at_least_t<33>>::value, "Zero bit unsigned int should be void");
+    static_assert(std::is_same<std::uint64_t, graphics2::pixel::uint_at_least_t<64>>::value, "Zero bit unsigned int should be void");
+//    static_assert(std::is_same<std::uint8_t, graphics2::pixel::uint_at_least_t<65>>::value, "Zero bit unsigned int should be void");
 }
 
 
 template<typename TYPE, TYPE r>
 int p() { return r; }
 
-void test_channel()
+inline void test_channel()
 {
-    constexpr graphics2::channel colorChannel{0.5};
-    constexpr graphics2::value_in_range<int, graphics2::numeric_range_t<int, 0, 10>> intColorChannel{5};
+    constexpr graphics2::pixel::channel colorChannel{0.5};
+    constexpr graphics2::pixel::value_in_range<int, graphics2::pixel::numeric_range_t<int, 0, 10>> intColorChannel{5};
     p<int, intColorChannel.value()>();
 }
 
-int test_channel_bits()
+inline int test_channel_bits()
 {
-    constexpr graphics2::channel_bits<5> colorChannel{100};
+    constexpr graphics2::pixel::channel_bits<5> colorChannel{100};
     return p<decltype(colorChannel)::type, colorChannel.value()>();
 }
 
-int test_color()
+inline int test_color()
 {
-    constexpr graphics2::color c(0, 0.5, 1, 0.5);
+    constexpr graphics2::pixel::color c(0, 0.5, 1, 0.5);
     static_assert(c.red().value() == 0, "");
     static_assert(c.is_valid(), "c should be valid");
-    constexpr graphics2::color_bits<1, 2, 3, 4> c2(c);
+    constexpr graphics2::pixel::color_bits<1, 2, 3, 4> c2(c);
     static_assert(c2.red().value() == 0, "red");
     static_assert(c2.green().value() == 1, "green");
     static_assert(c2.blue().value() == 7, "blue");
     static_assert(c2.alpha().value() == 7, "alpha");
+    return 0;
 }
 
-int main()
+inline int test_absent_channel()
 {
-    test_color();
+    constexpr graphics2::pixel::color_bits<5, 6, 5, 0> c(31, 0, 16, 0);
+    static_assert(c.alpha().value() == c.alpha().max(), "absent alpha is opaque");
+    constexpr graphics2::pixel::color_bits<8, 8, 8, 8> c2(c);
+    static_assert(c2.red().value() == 255, "red");
+    static_assert(c2.alpha().value() == 255, "alpha");
+    return 0;
 }
@@ -0,0 +1,169 @@
+#pragma once
+#include "color.h"
+#include "graphics.h"
+#include "pixels.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+namespace graphics2 {
+
+
+// A colormap quantized into SIZE entries, built at compile time from evenly
+// spaced color stops by linear interpolation.
+template<std::size_t SIZE>
+class colormap_t
+{
+public:
+    static_assert(SIZE >= 2, "a colormap needs at least two entries");
+
+    using entry = pixel::color_bits<8, 8, 8, 8>;
+
+    template<std::size_t STOPS>
+    explicit constexpr colormap_t(const std::array<pixel::color, STOPS>& stops)
+        : colormap_t(stops, std::make_index_sequence<SIZE>())
+    {}
+
+    constexpr std::size_t size() const { return SIZE; }
+    constexpr const entry& operator[](std::size_t index) const { return _entries[index]; }
+    constexpr std::uint32_t argb32(std::size_t index) const { return _argb32[index]; }
+
+private:
+    template<std::size_t STOPS, std::size_t... INDEX>
+    constexpr colormap_t(const std::array<pixel::color, STOPS>& stops, std::index_sequence<INDEX...>)
+        : _entries{{entry(interpolate(stops, INDEX))...}}
+        , _argb32{{to_argb32(entry(interpolate(stops, INDEX)))...}}
+    {}
+
+    template<std::size_t STOPS>
+    static constexpr pixel::color interpolate(const std::array<pixel::color, STOPS>& stops, std::size_t index)
+    {
+        static_assert(STOPS >= 1, "a colormap needs at least one color stop");
+        if (STOPS == 1)
+            return stops[0];
+        const double position = 1.0 * index * (STOPS - 1) / (SIZE - 1);
+        const std::size_t lower = position >= STOPS - 1 ? STOPS - 2 : static_cast<std::size_t>(position);
+        const double fraction = position - lower;
+        const auto& a = stops[lower];
+        const auto& b = stops[lower + 1];
+        return pixel::color(
+            a.red().value() + (b.red().value() - a.red().value()) * fraction,
+            a.green().value() + (b.green().value() - a.green().value()) * fraction,
+            a.blue().value() + (b.blue().value() - a.blue().value()) * fraction,
+            a.alpha().value() + (b.alpha().value() - a.alpha().value()) * fraction);
+    }
+
+    std::array<entry, SIZE> _entries;
+    std::array<std::uint32_t, SIZE> _argb32;
+};
+
+
+template<std::size_t SIZE, typename... COLORS>
+constexpr colormap_t<SIZE> make_colormap(const COLORS&... stops)
+{
+    return colormap_t<SIZE>(std::array<pixel::color, sizeof...(COLORS)>{{stops...}});
+}
+
+
+namespace detail {
+
+#ifdef __SSE2__
+
+    // (value - offset) * scale for four values, in the precision the scalar
+    // loop of apply_colormap uses for VALUE
+    template<typename VALUE>
+    __m128 colormap_positions(const VALUE* in, float offset, float scale)
+    {
+        if constexpr (std::is_same<VALUE, float>::value)
+        {
+            return _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(in), _mm_set1_ps(offset)), _mm_set1_ps(scale));
+        }
+        else
+        {
+            static_assert(std::is_same<VALUE, double>::value, "float or double values");
+            const __m128d o = _mm_set1_pd(offset);
+            const __m128d s = _mm_set1_pd(scale);
+            const __m128 lo = _mm_cvtpd_ps(_mm_mul_pd(_mm_sub_pd(_mm_loadu_pd(in), o), s));
+            const __m128 hi = _mm_cvtpd_ps(_mm_mul_pd(_mm_sub_pd(_mm_loadu_pd(in + 2), o), s));
+            return _mm_movelh_ps(lo, hi);
+        }
+    }
+
+#endif
+
+}
+
+
+// Maps a rows x columns scalar field onto the top left corner of an ARGB32 or
+// RGB24 image surface, one value per pixel, values outside [min, max] are
+// clamped. For float and double values the indices of four pixels at a time
+// are computed with SSE2, only the table lookups are scalar.
+template<std::size_t SIZE, typename VALUE>
+void apply_colormap(
+    const colormap_t<SIZE>& colormap,
+    const VALUE* values,
+    int columns,
+    int rows,
+    double min,
+    double max,
+    image_surface_t& surface)
+{
+    const auto format = surface.format();
+    if (format != Format::FORMAT_ARGB32 && format != Format::FORMAT_RGB24)
+        throw std::invalid_argument("apply_colormap needs an ARGB32 or RGB24 image surface");
+
+    const int width = columns < surface.width() ? columns : surface.width();
+    const int height = rows < surface.height() ? rows : surface.height();
+    const float scale = max > min ? (SIZE - 1) / (max - min) : 0;
+    const float offset = min;
+    const float last = SIZE - 1;
+
+    surface.flush();
+    auto* data = surface.data();
+    const auto stride = surface.stride();
+    for (int y = 0; y < height; ++y)
+    {
+        const VALUE* in = values + static_cast<std::ptrdiff_t>(y) * columns;
+        auto* out = reinterpret_cast<std::uint32_t*>(data + static_cast<std::ptrdiff_t>(y) * stride);
+        int x = 0;
+#ifdef __SSE2__
+        if constexpr (std::is_same<VALUE, float>::value || std::is_same<VALUE, double>::value)
+        {
+            alignas(16) std::int32_t index[4];
+            for (; x + 4 <= width; x += 4)
+            {
+                __m128 position = detail::colormap_positions(in + x, offset, scale);
+                // maxps returns its second operand for NaN, so NaN ends up at index 0
+                position = _mm_max_ps(position, _mm_setzero_ps());
+                position = _mm_min_ps(position, _mm_set1_ps(last));
+                _mm_store_si128(reinterpret_cast<__m128i*>(index),
+                    _mm_cvttps_epi32(_mm_add_ps(position, _mm_set1_ps(0.5f))));
+                out[x] = colormap.argb32(static_cast<std::size_t>(index[0]));
+                out[x + 1] = colormap.argb32(static_cast<std::size_t>(index[1]));
+                out[x + 2] = colormap.argb32(static_cast<std::size_t>(index[2]));
+                out[x + 3] = colormap.argb32(static_cast<std::size_t>(index[3]));
+            }
+        }
+#endif
+        for (; x < width; ++x)
+        {
+            float position = (in[x] - offset) * scale;
+            // written so that NaN ends up at index 0
+            position = position > 0 ? position : 0;
+            position = position < last ? position : last;
+            out[x] = colormap.argb32(static_cast<std::size_t>(position + 0.5f));
+        }
+    }
+    surface.mark_dirty();
+}
+
+
+}
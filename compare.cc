@@ -0,0 +1,156 @@
+#include "graphics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+namespace graphics2 {
+
+
+namespace detail {
+
+    // largest possible delta() between two pixels
+    constexpr double max_yiq_delta = 35215.0;
+
+
+    struct yiq_t
+    {
+        double y;
+        double i;
+        double q;
+    };
+
+
+    // premultiplied pixel composited onto white, then converted to YIQ
+    yiq_t to_yiq(std::uint32_t pixel)
+    {
+        const double white = 255 - (pixel >> 24);
+        const double r = (pixel >> 16 & 0xff) + white;
+        const double g = (pixel >> 8 & 0xff) + white;
+        const double b = (pixel & 0xff) + white;
+        return yiq_t{
+            r * 0.29889531 + g * 0.58662247 + b * 0.11448223,
+            r * 0.59597799 - g * 0.27417610 - b * 0.32180189,
+            r * 0.21147017 - g * 0.52261711 + b * 0.31114694};
+    }
+
+
+    double delta(std::uint32_t a, std::uint32_t b)
+    {
+        const auto ya = to_yiq(a);
+        const auto yb = to_yiq(b);
+        const double y = ya.y - yb.y;
+        const double i = ya.i - yb.i;
+        const double q = ya.q - yb.q;
+        return std::sqrt((0.5053 * y * y + 0.299 * i * i + 0.1957 * q * q) / max_yiq_delta);
+    }
+
+
+    // number of leading pixels that are equal
+    int equal_run(const std::uint32_t* a, const std::uint32_t* b, int count, std::uint32_t mask)
+    {
+        int x = 0;
+#ifdef __SSE2__
+        const __m128i m = _mm_set1_epi32(static_cast<int>(mask));
+        for (; x + 4 <= count; x += 4)
+        {
+            const __m128i pa = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + x)), m);
+            const __m128i pb = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + x)), m);
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(pa, pb)) != 0xffff)
+                break;
+        }
+#endif
+        while (x < count && (a[x] & mask) == (b[x] & mask))
+            ++x;
+        return x;
+    }
+
+
+    std::uint32_t faded(std::uint32_t pixel)
+    {
+        const double luma = to_yiq(pixel).y;
+        const auto gray = static_cast<std::uint32_t>(255 - (255 - luma) * 0.1);
+        return 0xff000000u | gray << 16 | gray << 8 | gray;
+    }
+
+}
+
+
+image_difference_t compare_images(
+    const image_surface_t& expected,
+    const image_surface_t& actual,
+    double threshold,
+    image_surface_t* heatmap)
+{
+    image_difference_t result;
+    for (const auto* surface: {&expected, &actual})
+    {
+        if (surface->format() != Format::FORMAT_ARGB32 && surface->format() != Format::FORMAT_RGB24)
+            throw std::invalid_argument("compare_images needs ARGB32 or RGB24 surfaces");
+    }
+    const int width = expected.width();
+    const int height = expected.height();
+    if (actual.width() != width || actual.height() != height)
+    {
+        result.size_mismatch = true;
+        return result;
+    }
+    if (heatmap && (heatmap->format() != Format::FORMAT_ARGB32 || heatmap->width() != width || heatmap->height() != height))
+        throw std::invalid_argument("compare_images heatmap must be an ARGB32 surface of the compared size");
+
+    // RGB24 leaves the alpha byte undefined, it reads as opaque
+    const std::uint32_t mask = expected.format() == Format::FORMAT_ARGB32 && actual.format() == Format::FORMAT_ARGB32
+        ? 0xffffffffu
+        : 0x00ffffffu;
+    const std::uint32_t opaque = ~mask;
+
+    expected.flush();
+    actual.flush();
+    if (heatmap)
+        heatmap->flush();
+    for (int y = 0; y < height; ++y)
+    {
+        const auto* a = reinterpret_cast<const std::uint32_t*>(expected.data() + std::ptrdiff_t(y) * expected.stride());
+        const auto* b = reinterpret_cast<const std::uint32_t*>(actual.data() + std::ptrdiff_t(y) * actual.stride());
+        auto* out = heatmap ? reinterpret_cast<std::uint32_t*>(heatmap->data() + std::ptrdiff_t(y) * heatmap->stride()) : nullptr;
+        int x = 0;
+        while (x < width)
+        {
+            const int run = detail::equal_run(a + x, b + x, width - x, mask);
+            if (out)
+            {
+                for (int i = x; i < x + run; ++i)
+                    out[i] = detail::faded(a[i] | opaque);
+            }
+            x += run;
+            if (x == width)
+                break;
+
+            const double d = detail::delta(a[x] | opaque, b[x] | opaque);
+            result.max_delta = std::max(result.max_delta, d);
+            const bool different = d > threshold;
+            if (different)
+                ++result.differing_pixels;
+            if (out)
+            {
+                const auto intensity = static_cast<std::uint32_t>(std::min(255.0, 128 + 127 * d));
+                out[x] = different
+                    ? 0xff000000u | intensity << 16
+                    : 0xff000000u | intensity << 16 | intensity << 8;
+            }
+            ++x;
+        }
+    }
+    if (heatmap)
+        heatmap->mark_dirty();
+    return result;
+}
+
+
+}
@@ -0,0 +1,219 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+// Porter-Duff row kernels on premultiplied pixels as cairo stores them, used
+// by surface_t::composite. Every kernel has an SSE2 body for four ARGB32
+// pixels or sixteen A8 pixels at a time and a scalar loop for the rest.
+
+
+namespace graphics2 {
+
+
+namespace detail {
+
+    // x / 255 rounded, exact for x <= 255 * 255
+    inline std::uint32_t div255(std::uint32_t x)
+    {
+        x += 128;
+        return (x + (x >> 8)) >> 8;
+    }
+
+
+    inline std::uint8_t over_channel(std::uint32_t s, std::uint32_t d, std::uint32_t sa)
+    {
+        return static_cast<std::uint8_t>(s + div255(d * (255 - sa)));
+    }
+
+
+    inline std::uint8_t add_channel(std::uint32_t s, std::uint32_t d)
+    {
+        const std::uint32_t sum = s + d;
+        return static_cast<std::uint8_t>(sum > 255 ? 255 : sum);
+    }
+
+
+    // the separable multiply blend mode, which also yields the result alpha
+    // when given the alphas
+    inline std::uint8_t multiply_channel(std::uint32_t s, std::uint32_t d, std::uint32_t sa, std::uint32_t da)
+    {
+        const std::uint32_t result = div255(s * (255 - da) + d * (255 - sa) + s * d);
+        return static_cast<std::uint8_t>(result > 255 ? 255 : result);
+    }
+
+
+#ifdef __SSE2__
+
+    inline __m128i div255_epu16(__m128i x)
+    {
+        x = _mm_add_epi16(x, _mm_set1_epi16(128));
+        return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+    }
+
+
+    // the alpha of each of the two pixels in eight 16 bit lanes
+    inline __m128i alpha_epu16(__m128i pixels)
+    {
+        return _mm_shufflehi_epi16(_mm_shufflelo_epi16(pixels, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    }
+
+
+    inline __m128i over_epu16(__m128i s, __m128i d)
+    {
+        const __m128i inverse = _mm_sub_epi16(_mm_set1_epi16(255), alpha_epu16(s));
+        return div255_epu16(_mm_mullo_epi16(d, inverse));
+    }
+
+
+    inline __m128i multiply_epu16(__m128i s, __m128i d)
+    {
+        const __m128i full = _mm_set1_epi16(255);
+        const __m128i sum = _mm_add_epi16(
+            _mm_add_epi16(
+                _mm_mullo_epi16(s, _mm_sub_epi16(full, alpha_epu16(d))),
+                _mm_mullo_epi16(d, _mm_sub_epi16(full, alpha_epu16(s)))),
+            _mm_mullo_epi16(s, d));
+        return div255_epu16(sum);
+    }
+
+#endif
+
+
+    // alpha forced to opaque for RGB24, whose top byte is undefined
+    inline void over_row(std::uint32_t* target, const std::uint32_t* source, int count, std::uint32_t opaque)
+    {
+        int x = 0;
+#ifdef __SSE2__
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i mask = _mm_set1_epi32(static_cast<int>(opaque));
+        for (; x + 4 <= count; x += 4)
+        {
+            const __m128i s = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + x)), mask);
+            const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(target + x));
+            const __m128i lo = over_epu16(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+            const __m128i hi = over_epu16(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(target + x), _mm_adds_epu8(s, _mm_packus_epi16(lo, hi)));
+        }
+#endif
+        for (; x < count; ++x)
+        {
+            const std::uint32_t s = source[x] | opaque;
+            const std::uint32_t d = target[x];
+            const std::uint32_t sa = s >> 24;
+            std::uint32_t result = 0;
+            for (int shift = 0; shift < 32; shift += 8)
+            {
+                result |= std::uint32_t(over_channel(s >> shift & 0xff, d >> shift & 0xff, sa)) << shift;
+            }
+            target[x] = result;
+        }
+    }
+
+
+    inline void add_row(std::uint32_t* target, const std::uint32_t* source, int count, std::uint32_t opaque)
+    {
+        int x = 0;
+#ifdef __SSE2__
+        const __m128i mask = _mm_set1_epi32(static_cast<int>(opaque));
+        for (; x + 4 <= count; x += 4)
+        {
+            const __m128i s = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + x)), mask);
+            const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(target + x));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(target + x), _mm_adds_epu8(s, d));
+        }
+#endif
+        for (; x < count; ++x)
+        {
+            const std::uint32_t s = source[x] | opaque;
+            const std::uint32_t d = target[x];
+            std::uint32_t result = 0;
+            for (int shift = 0; shift < 32; shift += 8)
+            {
+                result |= std::uint32_t(add_channel(s >> shift & 0xff, d >> shift & 0xff)) << shift;
+            }
+            target[x] = result;
+        }
+    }
+
+
+    inline void multiply_row(std::uint32_t* target, const std::uint32_t* source, int count, std::uint32_t opaque)
+    {
+        int x = 0;
+#ifdef __SSE2__
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i mask = _mm_set1_epi32(static_cast<int>(opaque));
+        for (; x + 4 <= count; x += 4)
+        {
+            const __m128i s = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + x)), mask);
+            const __m128i d = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(target + x)), mask);
+            const __m128i lo = multiply_epu16(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+            const __m128i hi = multiply_epu16(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(target + x), _mm_packus_epi16(lo, hi));
+        }
+#endif
+        for (; x < count; ++x)
+        {
+            const std::uint32_t s = source[x] | opaque;
+            const std::uint32_t d = target[x] | opaque;
+            const std::uint32_t sa = s >> 24;
+            const std::uint32_t da = d >> 24;
+            std::uint32_t result = 0;
+            for (int shift = 0; shift < 32; shift += 8)
+            {
+                result |= std::uint32_t(multiply_channel(s >> shift & 0xff, d >> shift & 0xff, sa, da)) << shift;
+            }
+            target[x] = result;
+        }
+    }
+
+
+    inline void over_row_a8(std::uint8_t* target, const std::uint8_t* source, int count)
+    {
+        int x = 0;
+#ifdef __SSE2__
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i full = _mm_set1_epi16(255);
+        for (; x + 16 <= count; x += 16)
+        {
+            const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + x));
+            const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(target + x));
+            const __m128i lo = div255_epu16(_mm_mullo_epi16(
+                _mm_unpacklo_epi8(d, zero), _mm_sub_epi16(full, _mm_unpacklo_epi8(s, zero))));
+            const __m128i hi = div255_epu16(_mm_mullo_epi16(
+                _mm_unpackhi_epi8(d, zero), _mm_sub_epi16(full, _mm_unpackhi_epi8(s, zero))));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(target + x), _mm_adds_epu8(s, _mm_packus_epi16(lo, hi)));
+        }
+#endif
+        for (; x < count; ++x)
+        {
+            target[x] = over_channel(source[x], target[x], source[x]);
+        }
+    }
+
+
+    inline void add_row_a8(std::uint8_t* target, const std::uint8_t* source, int count)
+    {
+        int x = 0;
+#ifdef __SSE2__
+        for (; x + 16 <= count; x += 16)
+        {
+            const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + x));
+            const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(target + x));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(target + x), _mm_adds_epu8(s, d));
+        }
+#endif
+        for (; x < count; ++x)
+        {
+            target[x] = add_channel(source[x], target[x]);
+        }
+    }
+
+}
+
+
+}
@@ -0,0 +1,136 @@
+#include "graphics.h"
+#include <cairomm/context.h>
+#include <cairomm/surface.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <utility>
+
+
+namespace {
+
+    // the same composite drawn by cairo on a context of its own, over the
+    // target's pixels
+    void cairo_composite(graphics2::image_surface_t& target, const graphics2::image_surface_t& source, graphics2::Operator op)
+    {
+        target.flush();
+        source.flush();
+        auto target_surface = Cairo::ImageSurface::create(
+            target.data(), target.format(), target.width(), target.height(), target.stride());
+        auto source_surface = Cairo::ImageSurface::create(
+            const_cast<unsigned char*>(source.data()), source.format(), source.width(), source.height(), source.stride());
+        auto context = Cairo::Context::create(target_surface);
+        context->set_source(source_surface, 0, 0);
+        context->set_operator(op);
+        context->rectangle(0, 0, source.width(), source.height());
+        context->fill();
+        target_surface->flush();
+        target.mark_dirty();
+    }
+
+
+    // the largest difference of a channel the format stores
+    int max_difference(const graphics2::image_surface_t& a, const graphics2::image_surface_t& b)
+    {
+        using namespace graphics2;
+        a.flush();
+        b.flush();
+        const auto format = a.format();
+        const int bytes = format == Format::FORMAT_A8 ? a.width() : a.width() * 4;
+        int difference = 0;
+        for (int y = 0; y < a.height(); ++y)
+        {
+            const auto* row_a = a.data() + y * a.stride();
+            const auto* row_b = b.data() + y * b.stride();
+            for (int x = 0; x < bytes; ++x)
+            {
+                // the top byte of RGB24 is undefined
+                if (format == Format::FORMAT_RGB24 && x % 4 == 3)
+                    continue;
+                difference = std::max(difference, std::abs(row_a[x] - row_b[x]));
+            }
+        }
+        return difference;
+    }
+
+}
+
+
+// Every operator the kernels handle, on every format they handle, against
+// cairo. Both round differently, a channel may differ by one. Returns the
+// number of combinations that differ by more.
+int compositing()
+{
+    using namespace graphics2;
+    using clock = std::chrono::steady_clock;
+    using seconds = std::chrono::duration<double>;
+
+    auto width = 1920;
+    auto height = 1080;
+    const int repeats = 10;
+
+    const std::pair<const char*, Format> formats[] = {
+        {"ARGB32", Format::FORMAT_ARGB32},
+        {"RGB24", Format::FORMAT_RGB24},
+        {"A8", Format::FORMAT_A8},
+    };
+    const std::pair<const char*, Operator> operators[] = {
+        {"over", Operator::OPERATOR_OVER},
+        {"source", Operator::OPERATOR_SOURCE},
+        {"add", Operator::OPERATOR_ADD},
+        {"multiply", Operator::OPERATOR_MULTIPLY},
+    };
+
+    int failures = 0;
+    for (const auto& format: formats)
+    {
+        image_surface_t overlay(format.second, width, height);
+        overlay.fill(
+            radial_gradient_t(pos_t(width / 2.0, height / 2.0), height / 2.0)
+                .add_color_stop(0, color_t(0.8, 0.2, 0.2, 0.9))
+                .add_color_stop(1, color_t(0.2, 0.2, 0.8, 0.1)));
+
+        for (const auto& op: operators)
+        {
+            // a translucent background so the destination alpha varies too
+            auto background = linear_gradient_t(pos_t(0, 0), pos_t(width, 0));
+            background
+                .add_color_stop(0, color_t(0.86, 0.85, 0.47, 1))
+                .add_color_stop(1, color_t(0.1, 0.5, 0.3, 0.2));
+            image_surface_t kernel(format.second, width, height);
+            image_surface_t reference(format.second, width, height);
+            kernel.fill(background);
+            reference.fill(background);
+
+            kernel.composite(overlay, pos_t(0, 0), op.second);
+            cairo_composite(reference, overlay, op.second);
+            const int difference = max_difference(kernel, reference);
+
+            auto start = clock::now();
+            for (int i = 0; i < repeats; ++i)
+                kernel.composite(overlay, pos_t(0, 0), op.second);
+            kernel.flush();
+            auto kernel_time = seconds(clock::now() - start).count();
+
+            start = clock::now();
+            for (int i = 0; i < repeats; ++i)
+                cairo_composite(reference, overlay, op.second);
+            reference.flush();
+            auto cairo_time = seconds(clock::now() - start).count();
+
+            const double megapixels = repeats * width * height / 1e6;
+            std::cout << op.first << " " << format.first << ", kernel: " << megapixels / kernel_time << " MP/s, "
+                      << "cairo: " << megapixels / cairo_time << " MP/s, "
+                      << "max channel difference: " << difference;
+            if (difference > 1)
+            {
+                std::cout << ", FAILED";
+                ++failures;
+            }
+            std::cout << std::endl;
+        }
+    }
+    return failures;
+}
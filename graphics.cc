@@ -1,8 +1,22 @@
 #include "graphics.h"
+#include "composite.h"
 
 #include <cairommconfig.h>
 #include <cairomm/context.h>
 #include <cairomm/surface.h>
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <locale>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
 
 
 namespace graphics2 {
@@ -21,21 +35,1163 @@ namespace detail {
     struct surface_t
     {
         Cairo::RefPtr<Cairo::Surface> surface;
+        // set for paged surfaces writing to a caller's stream, flushed per page
+        std::ostream* stream = nullptr;
+        quality_t quality = quality_t::good;
+        std::shared_ptr<graphics2::glyph_atlas_t> atlas{};
+        // pages show_page() may still start, -1 for no limit
+        int pages_left = -1;
         Cairo::Surface* operator->() { return surface.operator->(); }
     };
 
 
+    // good is what cairo does by default and needs no changes
+    void apply_quality(const Cairo::RefPtr<Cairo::Context>& context, quality_t quality)
+    {
+        if (quality == quality_t::good)
+            return;
+        const bool fast = quality == quality_t::fast;
+        Cairo::FontOptions font_options;
+        font_options.set_antialias(Cairo::ANTIALIAS_GRAY);
+        font_options.set_hint_style(fast ? Cairo::HINT_STYLE_FULL : Cairo::HINT_STYLE_NONE);
+        font_options.set_hint_metrics(fast ? Cairo::HINT_METRICS_ON : Cairo::HINT_METRICS_OFF);
+        context->set_antialias(fast ? Cairo::ANTIALIAS_FAST : Cairo::ANTIALIAS_BEST);
+        // curves are flattened to this many device units, cairo's default is 0.1
+        context->set_tolerance(fast ? 1.0 : 0.01);
+        context->set_font_options(font_options);
+    }
+
+
     struct context_t
     {
         explicit context_t(const surface_t& surface)
             : context(Cairo::Context::create(surface.surface))
-        {}
+        {
+            apply_quality(context, surface.quality);
+        }
 
         Cairo::RefPtr<Cairo::Context> context;
         Cairo::Context* operator->() { return context.operator->(); }
     };
 
 
+    Cairo::ImageSurface& image_surface(const surface_t& surface)
+    {
+        return dynamic_cast<Cairo::ImageSurface&>(*surface.surface.operator->());
+    }
+
+
+    void paint_scaled(
+        const surface_t& target,
+        const Cairo::RefPtr<Cairo::Surface>& source,
+        int columns,
+        int rows,
+        const pos_t& pos,
+        double width,
+        double height,
+        Filter filter)
+    {
+        if (columns <= 0 || rows <= 0 || width <= 0 || height <= 0)
+            return;
+        auto pattern = Cairo::SurfacePattern::create(source);
+        pattern->set_filter(filter);
+        // keeps bilinear filtering from fading out at the edges
+        pattern->set_extend(Cairo::EXTEND_PAD);
+        auto matrix = Cairo::scaling_matrix(columns / width, rows / height);
+        matrix.translate(-pos.x(), -pos.y());
+        pattern->set_matrix(matrix);
+
+        context_t context(target);
+        context->set_source(pattern);
+        context->rectangle(pos.x(), pos.y(), width, height);
+        context->fill();
+    }
+
+
+#ifdef __SSE2__
+
+    // the sums of the 2x2 blocks in sixteen bytes of two rows, eight 16 bit
+    // lanes holding eight A8 pixels or two ARGB32 pixels
+    template<int BYTES>
+    __m128i sum_2x2_epu16(const unsigned char* row0, const unsigned char* row1)
+    {
+        const __m128i top = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0));
+        const __m128i bottom = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1));
+        if constexpr (BYTES == 1)
+        {
+            // neighbours are the low and high byte of each 16 bit lane
+            const __m128i low = _mm_set1_epi16(0xff);
+            return _mm_add_epi16(
+                _mm_add_epi16(_mm_and_si128(top, low), _mm_srli_epi16(top, 8)),
+                _mm_add_epi16(_mm_and_si128(bottom, low), _mm_srli_epi16(bottom, 8)));
+        }
+        else
+        {
+            static_assert(BYTES == 4, "one or four bytes per pixel");
+            // neighbours are the two halves of each widened half
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero));
+            const __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+            return _mm_unpacklo_epi64(_mm_add_epi16(lo, _mm_srli_si128(lo, 8)), _mm_add_epi16(hi, _mm_srli_si128(hi, 8)));
+        }
+    }
+
+#endif
+
+
+    // averages 2x2 blocks per byte, BYTES being the bytes per pixel; the SSE2
+    // body writes sixteen bytes at a time with the same rounding as the
+    // scalar loop
+    template<int BYTES>
+    void downscale_2x2(
+        const unsigned char* source, int source_stride, int source_width, int source_height,
+        unsigned char* target, int target_stride, int target_width, int target_height)
+    {
+        const int full = std::min(target_width, source_width / 2);
+        for (int y = 0; y < target_height; ++y)
+        {
+            const auto* row0 = source + static_cast<std::ptrdiff_t>(2 * y) * source_stride;
+            const auto* row1 = source + static_cast<std::ptrdiff_t>(std::min(2 * y + 1, source_height - 1)) * source_stride;
+            auto* out = target + static_cast<std::ptrdiff_t>(y) * target_stride;
+            int x = 0;
+#ifdef __SSE2__
+            const __m128i two = _mm_set1_epi16(2);
+            for (; (x + 16 / BYTES) <= full; x += 16 / BYTES)
+            {
+                const int i = 2 * x * BYTES;
+                const __m128i a = _mm_srli_epi16(_mm_add_epi16(sum_2x2_epu16<BYTES>(row0 + i, row1 + i), two), 2);
+                const __m128i b = _mm_srli_epi16(_mm_add_epi16(sum_2x2_epu16<BYTES>(row0 + i + 16, row1 + i + 16), two), 2);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * BYTES), _mm_packus_epi16(a, b));
+            }
+#endif
+            for (; x < full; ++x)
+            {
+                for (int c = 0; c < BYTES; ++c)
+                {
+                    const unsigned sum =
+                        row0[(2 * x) * BYTES + c] + row0[(2 * x + 1) * BYTES + c] +
+                        row1[(2 * x) * BYTES + c] + row1[(2 * x + 1) * BYTES + c];
+                    out[x * BYTES + c] = static_cast<unsigned char>((sum + 2) >> 2);
+                }
+            }
+            // a one pixel wide source has nothing to pair with
+            for (int x = full; x < target_width; ++x)
+            {
+                for (int c = 0; c < BYTES; ++c)
+                {
+                    const unsigned sum = row0[(2 * x) * BYTES + c] + row1[(2 * x) * BYTES + c];
+                    out[x * BYTES + c] = static_cast<unsigned char>((sum + 1) >> 1);
+                }
+            }
+        }
+    }
+
+
+    // returns false when the kernels do not cover the combination
+    bool composite_pixels(Cairo::Surface& target_surface, const image_surface_t& source, const pos_t& pos, Operator op)
+    {
+        auto* target = dynamic_cast<Cairo::ImageSurface*>(&target_surface);
+        if (!target || target->get_format() != source.format())
+            return false;
+        const auto format = source.format();
+        if (format != Format::FORMAT_ARGB32 && format != Format::FORMAT_RGB24 && format != Format::FORMAT_A8)
+            return false;
+        if (op != Operator::OPERATOR_OVER && op != Operator::OPERATOR_SOURCE &&
+            op != Operator::OPERATOR_ADD && op != Operator::OPERATOR_MULTIPLY)
+            return false;
+        if (pos.x() != std::floor(pos.x()) || pos.y() != std::floor(pos.y()))
+            return false;
+
+        const int x = static_cast<int>(pos.x());
+        const int y = static_cast<int>(pos.y());
+        const int x0 = std::max(x, 0);
+        const int y0 = std::max(y, 0);
+        const int x1 = std::min(x + source.width(), target->get_width());
+        const int y1 = std::min(y + source.height(), target->get_height());
+        if (x0 >= x1 || y0 >= y1)
+            return true;
+        // the rows are written in place, so a source sharing the target's
+        // pixels goes to cairo, which copies it first
+        const auto source_begin = reinterpret_cast<std::uintptr_t>(source.data());
+        const auto target_begin = reinterpret_cast<std::uintptr_t>(target->get_data());
+        if (source_begin < target_begin + std::uintptr_t(target->get_stride()) * target->get_height() &&
+            target_begin < source_begin + std::uintptr_t(source.stride()) * source.height())
+            return false;
+
+        source.flush();
+        target->flush();
+        const int count = x1 - x0;
+        const int bytes = format == Format::FORMAT_A8 ? 1 : 4;
+        const std::uint32_t opaque = format == Format::FORMAT_RGB24 ? 0xff000000u : 0;
+        for (int row = y0; row < y1; ++row)
+        {
+            const auto* in = source.data() + std::ptrdiff_t(row - y) * source.stride() + (x0 - x) * bytes;
+            auto* out = target->get_data() + std::ptrdiff_t(row) * target->get_stride() + x0 * bytes;
+            if (op == Operator::OPERATOR_SOURCE)
+            {
+                std::memcpy(out, in, std::size_t(count) * bytes);
+            }
+            else if (bytes == 1)
+            {
+                // on alpha alone multiply and over are the same
+                if (op == Operator::OPERATOR_ADD)
+                    add_row_a8(out, in, count);
+                else
+                    over_row_a8(out, in, count);
+            }
+            else
+            {
+                auto* target_row = reinterpret_cast<std::uint32_t*>(out);
+                const auto* source_row = reinterpret_cast<const std::uint32_t*>(in);
+                if (op == Operator::OPERATOR_OVER)
+                    over_row(target_row, source_row, count, opaque);
+                else if (op == Operator::OPERATOR_ADD)
+                    add_row(target_row, source_row, count, opaque);
+                else
+                    multiply_row(target_row, source_row, count, opaque);
+            }
+        }
+        target->mark_dirty(x0, y0, count, y1 - y0);
+        return true;
+    }
+
+
+    // Glyph coverage masks packed into A8 pages on shelves, keyed by face,
+    // size, glyph and a quarter pixel horizontal offset.
+    struct glyph_atlas_t
+    {
+        static constexpr int page_size = 1024;
+        static constexpr int subpixel_steps = 4;
+
+        struct key_t
+        {
+            const cairo_font_face_t* face;
+            double size;
+            unsigned long index;
+            int subpixel;
+            // hinting and antialiasing change the mask
+            quality_t quality;
+
+            bool operator==(const key_t& other) const
+            {
+                return face == other.face && size == other.size && index == other.index &&
+                    subpixel == other.subpixel && quality == other.quality;
+            }
+        };
+
+        struct key_hash_t
+        {
+            std::size_t operator()(const key_t& key) const
+            {
+                std::size_t h = std::hash<const void*>()(key.face);
+                h = h * 31 + std::hash<double>()(key.size);
+                h = h * 31 + std::hash<unsigned long>()(key.index);
+                h = h * 31 + std::hash<int>()(key.subpixel);
+                return h * 31 + std::hash<int>()(static_cast<int>(key.quality));
+            }
+        };
+
+        // where the mask is and where its top left lands relative to the
+        // whole pixel pen position
+        struct entry_t
+        {
+            int page;
+            int x;
+            int y;
+            int width;
+            int height;
+            int offset_x;
+            int offset_y;
+        };
+
+        glyph_atlas_t(double max_size, std::size_t max_pages)
+            : max_size(max_size),
+              max_pages(max_pages)
+        {}
+
+        const entry_t& glyph(const Cairo::RefPtr<Cairo::FontFace>& face, double size, unsigned long index, int subpixel, quality_t quality)
+        {
+            // keyed on the cairo face, which cairo shares between toy faces
+            // of the same family, slant and weight
+            const key_t key{face->cobj(), size, index, subpixel, quality};
+            auto found = entries.find(key);
+            if (found != entries.end())
+                return found->second;
+            // rasterized first, a full atlas starts over while doing it
+            const auto entry = rasterize(face, size, index, subpixel, quality);
+            // holding on to the face keeps its address from being reused
+            const auto same_face = [&](const Cairo::RefPtr<Cairo::FontFace>& held) { return held->cobj() == key.face; };
+            if (std::none_of(faces.begin(), faces.end(), same_face))
+                faces.push_back(face);
+            return entries.emplace(key, entry).first->second;
+        }
+
+        entry_t rasterize(const Cairo::RefPtr<Cairo::FontFace>& face, double size, unsigned long index, int subpixel, quality_t quality)
+        {
+            auto scratch = Cairo::ImageSurface::create(Format::FORMAT_A8, 1, 1);
+            auto measure = Cairo::Context::create(scratch);
+            apply_quality(measure, quality);
+            measure->set_font_face(face);
+            measure->set_font_size(size);
+            Cairo::TextExtents extents;
+            measure->get_scaled_font()->glyph_extents({Cairo::Glyph{index, 0, 0}}, extents);
+            if (extents.width <= 0 || extents.height <= 0)
+                return entry_t{-1, 0, 0, 0, 0, 0, 0};
+
+            // a pixel of padding on each side and one more for the offset
+            const int left = static_cast<int>(std::floor(extents.x_bearing)) - 1;
+            const int top = static_cast<int>(std::floor(extents.y_bearing)) - 1;
+            const int width = static_cast<int>(std::ceil(extents.x_bearing + extents.width)) + 2 - left;
+            const int height = static_cast<int>(std::ceil(extents.y_bearing + extents.height)) + 1 - top;
+            if (width > page_size || height > page_size)
+                throw std::length_error("glyph larger than an atlas page");
+
+            auto mask = Cairo::ImageSurface::create(Format::FORMAT_A8, width, height);
+            auto context = Cairo::Context::create(mask);
+            apply_quality(context, quality);
+            context->set_font_face(face);
+            context->set_font_size(size);
+            context->set_source_rgba(0, 0, 0, 1);
+            context->show_glyphs({Cairo::Glyph{index, -left + double(subpixel) / subpixel_steps, double(-top)}});
+            mask->flush();
+
+            if (shelf_x + width > page_size)
+            {
+                shelf_x = 0;
+                shelf_y += shelf_height;
+                shelf_height = 0;
+            }
+            if (pages.empty() || shelf_y + height > page_size)
+            {
+                // faces and sizes come from whoever prints, so the pages
+                // are bounded by dropping everything once they are full
+                if (pages.size() >= max_pages)
+                {
+                    entries.clear();
+                    faces.clear();
+                    pages.clear();
+                }
+                pages.emplace_back(std::size_t(page_size) * page_size, 0);
+                shelf_x = 0;
+                shelf_y = 0;
+                shelf_height = 0;
+            }
+            entry_t entry{int(pages.size()) - 1, shelf_x, shelf_y, width, height, left, top};
+            auto& page = pages.back();
+            for (int y = 0; y < height; ++y)
+            {
+                std::memcpy(
+                    &page[std::size_t(entry.y + y) * page_size + entry.x],
+                    mask->get_data() + std::ptrdiff_t(y) * mask->get_stride(),
+                    width);
+            }
+            shelf_x += width;
+            shelf_height = std::max(shelf_height, height);
+            return entry;
+        }
+
+        // returns false when the text has to go through cairo instead
+        bool print(const surface_t& surface, const Cairo::RefPtr<Cairo::FontFace>& face, const font_t& font, const pos_t& pos, const std::string& text)
+        {
+            auto* image = dynamic_cast<Cairo::ImageSurface*>(surface.surface.operator->());
+            if (!image || font.size() > max_size)
+                return false;
+            auto& target = *image;
+            const auto format = target.get_format();
+            if (format != Format::FORMAT_ARGB32 && format != Format::FORMAT_RGB24)
+                return false;
+
+            // hint metrics move the glyphs, so they are laid out with the surface's options
+            auto context = Cairo::Context::create(surface.surface);
+            apply_quality(context, surface.quality);
+            context->set_font_face(face);
+            context->set_font_size(font.size());
+            std::vector<Cairo::Glyph> glyphs;
+            std::vector<Cairo::TextCluster> clusters;
+            Cairo::TextClusterFlags flags;
+            context->get_scaled_font()->text_to_glyphs(pos.x(), pos.y(), text, glyphs, clusters, flags);
+
+            const auto& color = font.color();
+            const std::uint32_t alpha = static_cast<std::uint32_t>(color.alpha() * 255 + 0.5);
+            const std::uint32_t source[4] = {
+                static_cast<std::uint32_t>(color.blue() * alpha + 0.5),
+                static_cast<std::uint32_t>(color.green() * alpha + 0.5),
+                static_cast<std::uint32_t>(color.red() * alpha + 0.5),
+                alpha};
+
+            target.flush();
+            auto* data = target.get_data();
+            const int stride = target.get_stride();
+            const int target_width = target.get_width();
+            const int target_height = target.get_height();
+            for (const auto& glyph: glyphs)
+            {
+                // rounded to the nearest step, which may be the next whole pixel
+                const double steps = std::floor(glyph.x * subpixel_steps + 0.5);
+                const double x = std::floor(steps / subpixel_steps);
+                const int subpixel = static_cast<int>(steps - x * subpixel_steps);
+                const auto& entry = this->glyph(face, font.size(), glyph.index, subpixel, surface.quality);
+                if (entry.page < 0)
+                    continue;
+                const auto& page = pages[entry.page];
+                const int left = static_cast<int>(x) + entry.offset_x;
+                const int top = static_cast<int>(std::lround(glyph.y)) + entry.offset_y;
+                for (int y = std::max(0, -top); y < entry.height && top + y < target_height; ++y)
+                {
+                    const auto* coverage = &page[std::size_t(entry.y + y) * page_size + entry.x];
+                    auto* out = reinterpret_cast<std::uint32_t*>(data + std::ptrdiff_t(top + y) * stride);
+                    for (int i = std::max(0, -left); i < entry.width && left + i < target_width; ++i)
+                    {
+                        const std::uint32_t c = coverage[i];
+                        if (c == 0)
+                            continue;
+                        const std::uint32_t d = out[left + i];
+                        const std::uint32_t sa = div255(source[3] * c);
+                        std::uint32_t result = 0;
+                        for (int channel = 0; channel < 4; ++channel)
+                        {
+                            const int shift = channel * 8;
+                            result |= (div255(source[channel] * c) + div255((d >> shift & 0xff) * (255 - sa))) << shift;
+                        }
+                        out[left + i] = result;
+                    }
+                }
+            }
+            target.mark_dirty();
+            return true;
+        }
+
+        double max_size;
+        std::size_t max_pages;
+        std::unordered_map<key_t, entry_t, key_hash_t> entries;
+        std::vector<Cairo::RefPtr<Cairo::FontFace>> faces;
+        std::vector<std::vector<std::uint8_t>> pages;
+        int shelf_x = 0;
+        int shelf_y = 0;
+        int shelf_height = 0;
+    };
+
+
+    void add_color_stops(const Cairo::RefPtr<Cairo::Gradient>& gradient, const gradient_t& stops)
+    {
+        for (const auto& stop: stops.color_stops())
+        {
+            const auto& color = stop.color;
+            gradient->add_color_stop_rgba(stop.offset, color.red(), color.green(), color.blue(), color.alpha());
+        }
+    }
+
+
+    // Rewrites cairo's svg output on its way to the stream: numbers in
+    // geometry attributes are rounded to the requested precision, and with
+    // deduplication a path drawn a second time is moved into <defs> and
+    // referenced by <use> from then on. Paths are compared relative to their
+    // first point, so the same marker at different positions is shared.
+    class svg_filter_t
+    {
+    public:
+        svg_filter_t(std::ostream& out, const svg_options_t& options)
+            : _out(out)
+            , _options(options)
+        {}
+
+        svg_filter_t(const std::string& filename, const svg_options_t& options)
+            : _file(new std::ofstream(filename, std::ios::binary | std::ios::trunc))
+            , _out(*_file)
+            , _options(options)
+        {
+            if (!*_file)
+                throw std::runtime_error("could not open \"" + filename + "\" for writing");
+        }
+
+        Cairo::ErrorStatus write(const unsigned char* data, unsigned int size)
+        {
+            const char* begin = reinterpret_cast<const char*>(data);
+            const char* end = begin + size;
+            while (begin != end)
+            {
+                if (_tag.empty())
+                {
+                    const char* open = std::find(begin, end, '<');
+                    _out.write(begin, open - begin);
+                    begin = open;
+                    if (begin == end)
+                        break;
+                }
+                // collects a tag until its closing bracket, which may arrive in a later write
+                for (; begin != end; ++begin)
+                {
+                    const char c = *begin;
+                    _tag += c;
+                    if (_quote)
+                    {
+                        if (c == _quote)
+                            _quote = 0;
+                    }
+                    else if (c == '"' || c == '\'')
+                    {
+                        _quote = c;
+                    }
+                    else if (c == '>')
+                    {
+                        ++begin;
+                        element(_tag);
+                        _tag.clear();
+                        break;
+                    }
+                }
+            }
+            return _out ? CAIRO_STATUS_SUCCESS : CAIRO_STATUS_WRITE_ERROR;
+        }
+
+    private:
+        struct attribute_t
+        {
+            std::string name;
+            std::string value;
+        };
+
+        static bool is_container(const std::string& name)
+        {
+            return
+                name == "defs" || name == "symbol" || name == "clipPath" ||
+                name == "mask" || name == "pattern" || name == "marker";
+        }
+
+        static bool is_geometry(const std::string& name)
+        {
+            static const std::set<std::string> names{
+                "d", "x", "y", "width", "height", "points",
+                "x1", "y1", "x2", "y2", "cx", "cy", "r", "rx", "ry", "fx", "fy"};
+            return names.count(name) != 0;
+        }
+
+        std::string number(double value) const
+        {
+            char buffer[64];
+            auto result = _options.precision < 0
+                ? std::to_chars(buffer, buffer + sizeof(buffer), value)
+                : std::to_chars(buffer, buffer + sizeof(buffer), value, std::chars_format::fixed, _options.precision);
+            std::string text(buffer, result.ptr);
+            if (_options.precision > 0 && text.find('.') != std::string::npos)
+            {
+                text.erase(text.find_last_not_of('0') + 1);
+                if (text.back() == '.')
+                    text.pop_back();
+            }
+            if (text == "-0")
+                text = "0";
+            return text;
+        }
+
+        static bool starts_number(const std::string& text, std::size_t i)
+        {
+            auto digit = [&](std::size_t j) { return j < text.size() && std::isdigit(static_cast<unsigned char>(text[j])); };
+            if (digit(i))
+                return true;
+            if (text[i] == '.')
+                return digit(i + 1);
+            if (text[i] == '-' || text[i] == '+')
+                return digit(i + 1) || (i + 1 < text.size() && text[i + 1] == '.' && digit(i + 2));
+            return false;
+        }
+
+        // numbers before the first one to round are kept as they are
+        std::string quantize(const std::string& value, int first=0) const
+        {
+            std::string result;
+            result.reserve(value.size());
+            int count = 0;
+            for (std::size_t i = 0; i < value.size();)
+            {
+                // from_chars ignores the locale, strtod would stop at the '.'
+                // under a comma decimal LC_NUMERIC; it takes no '+' though
+                double d = 0;
+                const char* begin = value.data() + i + (value[i] == '+' ? 1 : 0);
+                const auto parsed = starts_number(value, i)
+                    ? std::from_chars(begin, value.data() + value.size(), d)
+                    : std::from_chars_result{begin, std::errc::invalid_argument};
+                if (parsed.ec == std::errc() && parsed.ptr != begin)
+                {
+                    const auto next = static_cast<std::size_t>(parsed.ptr - value.data());
+                    if (count++ < first)
+                        result.append(value, i, next - i);
+                    else
+                        result += number(d);
+                    i = next;
+                }
+                else
+                {
+                    result += value[i++];
+                }
+            }
+            return result;
+        }
+
+        // Only the translations of a transform are coordinates, its scale,
+        // rotation and skew terms would collapse when rounded like them.
+        std::string quantize_transform(const std::string& value) const
+        {
+            std::string result;
+            result.reserve(value.size());
+            std::size_t i = 0;
+            while (i < value.size())
+            {
+                const auto open = value.find('(', i);
+                const auto close = open == std::string::npos ? open : value.find(')', open);
+                if (close == std::string::npos)
+                {
+                    result.append(value, i, std::string::npos);
+                    break;
+                }
+                const auto name_begin = value.find_first_not_of(" \t\r\n,", i);
+                const auto name = value.substr(name_begin, value.find_last_not_of(" \t\r\n", open - 1) + 1 - name_begin);
+                const auto arguments = value.substr(open + 1, close - open - 1);
+                result.append(value, i, open + 1 - i);
+                if (name == "translate")
+                    result += quantize(arguments);
+                else if (name == "matrix")
+                    result += quantize(arguments, 4);
+                else
+                    result += arguments;
+                result += ')';
+                i = close + 1;
+            }
+            return result;
+        }
+
+        // moves an absolute M/L/C/Z path to its first point, returns false for
+        // anything else
+        bool relative_to_start(const std::string& d, std::string& shape, double& x0, double& y0) const
+        {
+            std::istringstream in(d);
+            in.imbue(std::locale::classic());
+            char command = 0;
+            bool first = true;
+            shape.clear();
+            while (in >> std::ws && in.peek() != EOF)
+            {
+                const char c = static_cast<char>(in.peek());
+                if (std::isalpha(static_cast<unsigned char>(c)))
+                {
+                    in.get();
+                    if (c != 'M' && c != 'L' && c != 'C' && c != 'Z' && c != 'z')
+                        return false;
+                    command = c;
+                    shape += c;
+                    shape += ' ';
+                    continue;
+                }
+                if (command != 'M' && command != 'L' && command != 'C')
+                    return false;
+                double x = 0;
+                double y = 0;
+                if (!(in >> x))
+                    return false;
+                in >> std::ws;
+                if (in.peek() == ',')
+                    in.get();
+                if (!(in >> y))
+                    return false;
+                if (first)
+                {
+                    x0 = x;
+                    y0 = y;
+                    first = false;
+                }
+                shape += number(x - x0) + ' ' + number(y - y0) + ' ';
+            }
+            if (first)
+                return false;
+            shape.pop_back();
+            return true;
+        }
+
+        void element(const std::string& tag)
+        {
+            if (tag.compare(0, 2, "</") == 0)
+            {
+                const auto name = tag.substr(2, tag.find_first_of(" \t\r\n>", 2) - 2);
+                if (is_container(name) && _containers > 0)
+                    --_containers;
+                _out << tag;
+                return;
+            }
+            if (tag.compare(0, 2, "<?") == 0 || tag.compare(0, 2, "<!") == 0)
+            {
+                _out << tag;
+                return;
+            }
+
+            const bool self_closing = tag.size() >= 2 && tag[tag.size() - 2] == '/';
+            std::size_t pos = 1;
+            const auto name_end = tag.find_first_of(" \t\r\n/>", pos);
+            const auto name = tag.substr(pos, name_end - pos);
+            std::vector<attribute_t> attributes;
+            pos = name_end;
+            while (true)
+            {
+                pos = tag.find_first_not_of(" \t\r\n", pos);
+                if (pos == std::string::npos || tag[pos] == '/' || tag[pos] == '>')
+                    break;
+                const auto equals = tag.find('=', pos);
+                if (equals == std::string::npos)
+                    break;
+                const auto quote = tag.find_first_of("\"'", equals);
+                const auto close = tag.find(tag[quote], quote + 1);
+                attribute_t attribute{tag.substr(pos, tag.find_last_not_of(" \t\r\n", equals - 1) + 1 - pos), tag.substr(quote + 1, close - quote - 1)};
+                if (_options.precision >= 0 && is_geometry(attribute.name))
+                    attribute.value = quantize(attribute.value);
+                else if (_options.precision >= 0 && attribute.name == "transform")
+                    attribute.value = quantize_transform(attribute.value);
+                attributes.push_back(std::move(attribute));
+                pos = close + 1;
+            }
+
+            if (is_container(name) && !self_closing)
+                ++_containers;
+
+            if (name == "path" && self_closing && _containers == 0 && _options.deduplicate && use(attributes))
+                return;
+
+            _out << '<' << name;
+            for (const auto& attribute: attributes)
+            {
+                _out << ' ' << attribute.name << "=\"" << attribute.value << '"';
+            }
+            _out << (self_closing ? "/>" : ">");
+        }
+
+        bool use(const std::vector<attribute_t>& attributes)
+        {
+            // shorter paths cost less than the <use> that would replace them
+            const std::size_t min_length = 40;
+            auto d = std::find_if(attributes.begin(), attributes.end(), [](const attribute_t& a) { return a.name == "d"; });
+            if (d == attributes.end() || d->value.size() < min_length)
+                return false;
+            std::string shape;
+            double x0 = 0;
+            double y0 = 0;
+            if (!relative_to_start(d->value, shape, x0, y0))
+                return false;
+
+            auto& id = _shapes[shape];
+            if (id == 0)
+            {
+                // first sighting, most paths are unique so only remember it
+                id = -1;
+                return false;
+            }
+            if (id < 0)
+            {
+                id = ++_last_id;
+                _out << "<defs><path id=\"g2s" << id << "\" d=\"" << shape << "\"/></defs>";
+            }
+            _out << "<use xlink:href=\"#g2s" << id << "\" x=\"" << number(x0) << "\" y=\"" << number(y0) << '"';
+            for (const auto& attribute: attributes)
+            {
+                if (attribute.name != "d")
+                    _out << ' ' << attribute.name << "=\"" << attribute.value << '"';
+            }
+            _out << "/>";
+            return true;
+        }
+
+        std::unique_ptr<std::ofstream> _file;
+        std::ostream& _out;
+        svg_options_t _options;
+        std::string _tag;
+        char _quote = 0;
+        int _containers = 0;
+        std::unordered_map<std::string, int> _shapes;
+        int _last_id = 0;
+    };
+
+
+    Cairo::SlotWriteFunc write_to(std::ostream& out)
+    {
+        return [&out](const unsigned char* data, unsigned int size)
+        {
+            out.write(reinterpret_cast<const char*>(data), size);
+            return out ? CAIRO_STATUS_SUCCESS : CAIRO_STATUS_WRITE_ERROR;
+        };
+    }
+
+
+    Cairo::RefPtr<Cairo::SvgSurface> create_svg_surface(std::shared_ptr<svg_filter_t> filter, double width, double height)
+    {
+        return Cairo::SvgSurface::create_for_stream(
+            [filter](const unsigned char* data, unsigned int size) { return filter->write(data, size); },
+            width,
+            height);
+    }
+
+
+    // A reference to a cairo font face. cairo counts its references
+    // atomically, Cairo::RefPtr does not, so buffers recorded on several
+    // threads from the same font_t hold the face like this.
+    class font_face_ref_t
+    {
+    public:
+        explicit font_face_ref_t(cairo_font_face_t* face)
+            : _face(cairo_font_face_reference(face))
+        {}
+
+        font_face_ref_t(const font_face_ref_t& other)
+            : _face(cairo_font_face_reference(other._face))
+        {}
+
+        font_face_ref_t(font_face_ref_t&& other)
+            : _face(other._face)
+        {
+            other._face = nullptr;
+        }
+
+        font_face_ref_t& operator=(font_face_ref_t other)
+        {
+            std::swap(_face, other._face);
+            return *this;
+        }
+
+        ~font_face_ref_t()
+        {
+            if (_face)
+                cairo_font_face_destroy(_face);
+        }
+
+        cairo_font_face_t* get() const
+        {
+            return _face;
+        }
+
+        // a cairomm wrapper of its own for the thread that uses it
+        Cairo::RefPtr<Cairo::FontFace> font_face() const
+        {
+            return Cairo::RefPtr<Cairo::FontFace>(new Cairo::FontFace(_face, false));
+        }
+
+    private:
+        cairo_font_face_t* _face;
+    };
+
+
+    // Commands with the segments, points, texts and faces they refer to in
+    // flat arrays, a command holds its range of each.
+    struct command_buffer_t
+    {
+        static constexpr std::uint32_t magic = 0x42433247; // "G2CB"
+        static constexpr std::uint32_t version = 2;
+
+        enum class op_t : std::uint8_t
+        {
+            paint,
+            fill,
+            stroke,
+            print,
+        };
+
+        struct command_t
+        {
+            op_t op;
+            color_t color;
+            // pen width or font size
+            double size;
+            pos_t pos;
+            std::uint32_t segment;
+            std::uint32_t segments;
+            std::uint32_t point;
+            std::uint32_t text;
+            std::uint32_t face;
+            std::uint64_t key;
+        };
+
+        // points of a cairo path segment, two doubles each
+        static int points_of(std::uint8_t segment)
+        {
+            switch (segment)
+            {
+            case CAIRO_PATH_MOVE_TO:
+            case CAIRO_PATH_LINE_TO:
+                return 1;
+            case CAIRO_PATH_CURVE_TO:
+                return 3;
+            default:
+                return 0;
+            }
+        }
+
+        command_t& add(op_t op, const color_t& color, double size=0, const pos_t& pos=pos_t(0, 0))
+        {
+            commands.push_back(command_t{
+                op, color, size, pos,
+                static_cast<std::uint32_t>(segments.size()), 0,
+                static_cast<std::uint32_t>(points.size() / 2), 0, 0, key});
+            return commands.back();
+        }
+
+        // copies a command of another buffer with what it refers to
+        void append(const command_buffer_t& from, const command_t& command)
+        {
+            auto copy = command;
+            if (command.op == op_t::fill || command.op == op_t::stroke)
+            {
+                const auto first = from.segments.begin() + command.segment;
+                std::size_t point_count = 0;
+                for (auto segment = first; segment != first + command.segments; ++segment)
+                {
+                    point_count += points_of(*segment);
+                }
+                copy.segment = static_cast<std::uint32_t>(segments.size());
+                copy.point = static_cast<std::uint32_t>(points.size() / 2);
+                segments.insert(segments.end(), first, first + command.segments);
+                const auto point = from.points.begin() + 2 * std::ptrdiff_t(command.point);
+                points.insert(points.end(), point, point + 2 * std::ptrdiff_t(point_count));
+            }
+            else if (command.op == op_t::print)
+            {
+                copy.text = static_cast<std::uint32_t>(texts.size());
+                copy.face = add_face(from.faces[command.face].get());
+                texts.push_back(from.texts[command.text]);
+            }
+            commands.push_back(copy);
+        }
+
+        // paths are applied to a context on a one pixel surface and copied
+        // back from cairo
+        context_t& scratch_context()
+        {
+            if (!scratch)
+                scratch.reset(new context_t(surface_t{Cairo::ImageSurface::create(Format::FORMAT_A8, 1, 1)}));
+            (*scratch)->begin_new_path();
+            return *scratch;
+        }
+
+        void add_segments(command_t& command, const cairo_path_t& path)
+        {
+            for (int i = 0; i < path.num_data; i += path.data[i].header.length)
+            {
+                const auto type = static_cast<std::uint8_t>(path.data[i].header.type);
+                segments.push_back(type);
+                for (int p = 1; p <= points_of(type); ++p)
+                {
+                    points.push_back(path.data[i + p].point.x);
+                    points.push_back(path.data[i + p].point.y);
+                }
+            }
+            command.segments = static_cast<std::uint32_t>(segments.size() - command.segment);
+        }
+
+        std::uint32_t add_face(cairo_font_face_t* face)
+        {
+            for (std::size_t i = 0; i < faces.size(); ++i)
+            {
+                if (faces[i].get() == face)
+                    return static_cast<std::uint32_t>(i);
+            }
+            faces.emplace_back(face);
+            return static_cast<std::uint32_t>(faces.size() - 1);
+        }
+
+        void apply_path(context_t& context, const command_t& command) const
+        {
+            const double* p = points.data() + 2 * std::size_t(command.point);
+            for (std::size_t s = command.segment; s < std::size_t(command.segment) + command.segments; ++s)
+            {
+                switch (segments[s])
+                {
+                case CAIRO_PATH_MOVE_TO:
+                    context->move_to(p[0], p[1]);
+                    break;
+                case CAIRO_PATH_LINE_TO:
+                    context->line_to(p[0], p[1]);
+                    break;
+                case CAIRO_PATH_CURVE_TO:
+                    context->curve_to(p[0], p[1], p[2], p[3], p[4], p[5]);
+                    break;
+                default:
+                    context->close_path();
+                    break;
+                }
+                p += 2 * points_of(segments[s]);
+            }
+        }
+
+        // after deserializing, so replay can trust every range
+        void validate() const
+        {
+            for (const auto& command: commands)
+            {
+                if (command.op == op_t::fill || command.op == op_t::stroke)
+                {
+                    if (std::size_t(command.segment) + command.segments > segments.size())
+                        throw std::runtime_error("command buffer segments out of range");
+                    std::size_t end = command.point;
+                    for (std::size_t s = command.segment; s < std::size_t(command.segment) + command.segments; ++s)
+                    {
+                        if (segments[s] > CAIRO_PATH_CLOSE_PATH)
+                            throw std::runtime_error("unknown command buffer segment");
+                        end += points_of(segments[s]);
+                    }
+                    if (end > points.size() / 2)
+                        throw std::runtime_error("command buffer points out of range");
+                }
+                else if (command.op == op_t::print)
+                {
+                    if (command.text >= texts.size() || command.face >= faces.size())
+                        throw std::runtime_error("command buffer text out of range");
+                }
+                else if (command.op != op_t::paint)
+                {
+                    throw std::runtime_error("unknown command buffer operation");
+                }
+            }
+        }
+
+        std::vector<command_t> commands;
+        std::vector<std::uint8_t> segments;
+        std::vector<double> points;
+        std::vector<std::string> texts;
+        std::vector<font_face_ref_t> faces;
+        // given to the commands recorded from now on
+        std::uint64_t key = 0;
+        std::unique_ptr<context_t> scratch;
+    };
+
+
+    // All commands ordered by key, a stable sort keeps equal keys in the
+    // order of the buffers and in recording order within each.
+    void merge(const std::vector<const command_buffer_t*>& buffers, command_buffer_t& result)
+    {
+        struct entry_t
+        {
+            std::uint64_t key;
+            const command_buffer_t* buffer;
+            const command_buffer_t::command_t* command;
+        };
+        std::vector<entry_t> entries;
+        std::size_t count = 0;
+        for (const auto* buffer: buffers)
+        {
+            count += buffer->commands.size();
+        }
+        entries.reserve(count);
+        for (const auto* buffer: buffers)
+        {
+            for (const auto& command: buffer->commands)
+            {
+                entries.push_back(entry_t{command.key, buffer, &command});
+            }
+        }
+        std::stable_sort(entries.begin(), entries.end(),
+            [](const entry_t& a, const entry_t& b) { return a.key < b.key; });
+        result.commands.reserve(result.commands.size() + count);
+        for (const auto& entry: entries)
+        {
+            result.append(*entry.buffer, *entry.command);
+        }
+    }
+
+
+    struct scene_recorder_t
+    {
+        std::mutex mutex;
+        // by slot, null for slots never asked for
+        std::vector<std::unique_ptr<graphics2::command_buffer_t>> buffers;
+    };
+
+
+    // replays the segments of one recorded command
+    class recorded_path_t: public path_base_t
+    {
+    public:
+        recorded_path_t(const command_buffer_t& buffer, const command_buffer_t::command_t& command)
+            : _buffer(buffer)
+            , _command(command)
+        {}
+
+    private:
+        void apply_to_context(context_t& context) const override
+        {
+            _buffer.apply_path(context, _command);
+        }
+
+        const command_buffer_t& _buffer;
+        const command_buffer_t::command_t& _command;
+    };
+
+
+    class recorded_font_face_t: public graphics2::font_face_t
+    {
+    public:
+        explicit recorded_font_face_t(Cairo::RefPtr<Cairo::FontFace> face)
+            : graphics2::font_face_t(detail::font_face_t{std::move(face)})
+        {}
+    };
+
+
+    // native byte order, the bytes only travel between processes on one machine
+    template<typename T>
+    void write_value(std::string& out, const T& value)
+    {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+
+    void write_string(std::string& out, const std::string& value)
+    {
+        write_value(out, static_cast<std::uint32_t>(value.size()));
+        out += value;
+    }
+
+
+    class byte_reader_t
+    {
+    public:
+        byte_reader_t(const void* data, std::size_t size)
+            : _data(static_cast<const char*>(data))
+            , _left(size)
+        {}
+
+        template<typename T>
+        T read()
+        {
+            T value;
+            std::memcpy(&value, take(sizeof(T)), sizeof(T));
+            return value;
+        }
+
+        std::string read_string()
+        {
+            const auto size = read<std::uint32_t>();
+            return std::string(take(size), size);
+        }
+
+        template<typename T>
+        void read_array(std::vector<T>& values)
+        {
+            const auto count = read<std::uint32_t>();
+            if (count > _left / sizeof(T))
+                throw std::runtime_error("truncated command buffer");
+            values.resize(count);
+            std::memcpy(values.data(), take(count * sizeof(T)), count * sizeof(T));
+        }
+
+    private:
+        const char* take(std::size_t size)
+        {
+            if (size > _left)
+                throw std::runtime_error("truncated command buffer");
+            const char* data = _data;
+            _data += size;
+            _left -= size;
+            return data;
+        }
+
+        const char* _data;
+        std::size_t _left;
+    };
+
+
 }
 
 
@@ -66,13 +1222,36 @@ toy_font_face_t::toy_font_face_t(const std::string& family, FontSlant slant, Fon
 }
 
 
+surface_t::surface_t(surface_t&& other)
+    : _surface(std::move(other._surface))
+{}
+
+
 surface_t::~surface_t()
 {}
 
 
+void surface_t::quality(quality_t quality)
+{
+    _surface->quality = quality;
+}
+
+
+quality_t surface_t::quality() const
+{
+    return _surface->quality;
+}
+
+
 void surface_t::show_page()
 {
+    if (_surface->pages_left == 0)
+        throw std::logic_error("an EPS document has a single page");
+    if (_surface->pages_left > 0)
+        --_surface->pages_left;
     (*_surface)->show_page();
+    if (_surface->stream)
+        _surface->stream->flush();
 }
 
 
@@ -93,6 +1272,23 @@ void surface_t::fill(const color_t& color, const path_base_t& path)
 }
 
 
+void surface_t::fill(const pattern_base_t& pattern)
+{
+    detail::context_t context(*_surface);
+    pattern.apply_to_context(context);
+    context->paint();
+}
+
+
+void surface_t::fill(const pattern_base_t& pattern, const path_base_t& path)
+{
+    detail::context_t context(*_surface);
+    path.apply_to_context(context);
+    pattern.apply_to_context(context);
+    context->fill();
+}
+
+
 void surface_t::stroke(const pen_t& pen, const path_base_t& path)
 {
     detail::context_t context(*_surface);
@@ -106,6 +1302,8 @@ void surface_t::stroke(const pen_t& pen, const path_base_t& path)
 
 void surface_t::print(const font_t& font, const pos_t& pos, const std::string& text)
 {
+    if (_surface->atlas && _surface->atlas->_atlas->print(*_surface, font.font_face()._font_face->font_face, font, pos, text))
+        return;
     detail::context_t context(*_surface);
     context->move_to(pos.x(), pos.y());
     const auto& color = font.color();
@@ -116,6 +1314,36 @@ void surface_t::print(const font_t& font, const pos_t& pos, const std::string& t
 }
 
 
+void surface_t::draw_image(const image_surface_t& image, const pos_t& pos, double width, double height, Filter filter)
+{
+    detail::paint_scaled(*_surface, image._surface->surface, image.width(), image.height(), pos, width, height, filter);
+}
+
+
+void surface_t::draw_pixels(
+    const unsigned char* data, Format format, int columns, int rows, int stride,
+    const pos_t& pos, double width, double height, Filter filter)
+{
+    // cairo only reads from the source surface, the const_cast is safe
+    auto source = Cairo::ImageSurface::create(const_cast<unsigned char*>(data), format, columns, rows, stride);
+    detail::paint_scaled(*_surface, source, columns, rows, pos, width, height, filter);
+}
+
+
+void surface_t::composite(const image_surface_t& source, const pos_t& pos, Operator op)
+{
+    if (detail::composite_pixels(*_surface->surface.operator->(), source, pos, op))
+        return;
+    // limited to the source rectangle like the kernels, unbounded operators
+    // would otherwise clear the rest of the surface
+    detail::context_t context(*_surface);
+    context->set_source(source._surface->surface, pos.x(), pos.y());
+    context->set_operator(op);
+    context->rectangle(pos.x(), pos.y(), source.width(), source.height());
+    context->fill();
+}
+
+
 surface_t::surface_t(detail::surface_t surface)
     : _surface(new detail::surface_t(std::move(surface)))
 {
@@ -128,9 +1356,127 @@ image_surface_t::image_surface_t(Format format, double width, double height)
 }
 
 
+image_surface_t::image_surface_t(unsigned char* data, Format format, int width, int height, int stride)
+    : surface_t(detail::surface_t{Cairo::ImageSurface::create(data, format, width, height, stride)})
+{
+}
+
+
+image_surface_t image_surface_t::from_png(const std::string& filename)
+{
+    return image_surface_t(detail::surface_t{Cairo::ImageSurface::create_from_png(filename)});
+}
+
+
+int image_surface_t::stride_for_width(Format format, int width)
+{
+    return Cairo::ImageSurface::format_stride_for_width(format, width);
+}
+
+
+image_surface_t::image_surface_t(detail::surface_t surface)
+    : surface_t(std::move(surface))
+{
+}
+
+
+void image_surface_t::glyph_atlas(std::shared_ptr<glyph_atlas_t> atlas)
+{
+    _surface->atlas = std::move(atlas);
+}
+
+
 void image_surface_t::write_to_png(const std::string& filename)
 {
-    dynamic_cast<Cairo::ImageSurface&>(*_surface->surface.operator->()).write_to_png(filename);
+    detail::image_surface(*_surface).write_to_png(filename);
+}
+
+
+Format image_surface_t::format() const
+{
+    return detail::image_surface(*_surface).get_format();
+}
+
+
+int image_surface_t::width() const
+{
+    return detail::image_surface(*_surface).get_width();
+}
+
+
+int image_surface_t::height() const
+{
+    return detail::image_surface(*_surface).get_height();
+}
+
+
+int image_surface_t::stride() const
+{
+    return detail::image_surface(*_surface).get_stride();
+}
+
+
+unsigned char* image_surface_t::data()
+{
+    return detail::image_surface(*_surface).get_data();
+}
+
+
+const unsigned char* image_surface_t::data() const
+{
+    return detail::image_surface(*_surface).get_data();
+}
+
+
+void image_surface_t::flush() const
+{
+    (*_surface)->flush();
+}
+
+
+void image_surface_t::mark_dirty()
+{
+    (*_surface)->mark_dirty();
+}
+
+
+std::vector<image_surface_t> image_surface_t::mipmaps(std::size_t levels) const
+{
+    std::vector<image_surface_t> result;
+    result.reserve(levels);
+    (*_surface)->flush();
+    const image_surface_t* source = this;
+    for (std::size_t level = 0; level < levels; ++level)
+    {
+        const int width = std::max(1, source->width() / 2);
+        const int height = std::max(1, source->height() / 2);
+        const auto format = source->format();
+        result.emplace_back(format, width, height);
+        auto& target = result.back();
+        target.flush();
+        switch (format)
+        {
+        case Format::FORMAT_ARGB32:
+        case Format::FORMAT_RGB24:
+            detail::downscale_2x2<4>(
+                source->data(), source->stride(), source->width(), source->height(),
+                target.data(), target.stride(), width, height);
+            target.mark_dirty();
+            break;
+        case Format::FORMAT_A8:
+            detail::downscale_2x2<1>(
+                source->data(), source->stride(), source->width(), source->height(),
+                target.data(), target.stride(), width, height);
+            target.mark_dirty();
+            break;
+        default:
+            // no packed byte channels, let cairo do the filtering
+            target.draw_image(*source, pos_t(0, 0), width, height, Filter::FILTER_GOOD);
+            break;
+        }
+        source = &target;
+    }
+    return result;
 }
 
 
@@ -140,6 +1486,471 @@ svg_surface_t::svg_surface_t(const std::string& filename, double width, double h
 }
 
 
+svg_surface_t::svg_surface_t(const std::string& filename, double width, double height, const svg_options_t& options)
+    : surface_t(detail::surface_t{detail::create_svg_surface(
+        std::make_shared<detail::svg_filter_t>(filename, options), width, height)})
+{
+}
+
+
+svg_surface_t::svg_surface_t(std::ostream& out, double width, double height, const svg_options_t& options)
+    : surface_t(detail::surface_t{detail::create_svg_surface(
+        std::make_shared<detail::svg_filter_t>(out, options), width, height)})
+{
+}
+
+
+svg_surface_t::~svg_surface_t()
+{
+    // writes the remaining document while the stream is known to be alive
+    if (_surface)
+        (*_surface)->finish();
+}
+
+
+// cairo writes every page's content as soon as it is shown and only keeps
+// what is shared between pages, fonts are subset once for the whole document
+// and images drawn from the same image_surface_t are embedded once
+pdf_surface_t::pdf_surface_t(const std::string& filename, double width, double height)
+    : surface_t(detail::surface_t{Cairo::PdfSurface::create(filename, width, height)})
+{
+}
+
+
+pdf_surface_t::pdf_surface_t(std::ostream& out, double width, double height)
+    : surface_t(detail::surface_t{Cairo::PdfSurface::create_for_stream(detail::write_to(out), width, height), &out})
+{
+}
+
+
+pdf_surface_t::~pdf_surface_t()
+{
+    if (_surface)
+        (*_surface)->finish();
+}
+
+
+void pdf_surface_t::page_size(double width, double height)
+{
+    Cairo::RefPtr<Cairo::PdfSurface>::cast_static(_surface->surface)->set_size(width, height);
+}
+
+
+ps_surface_t::ps_surface_t(const std::string& filename, double width, double height, bool eps)
+    : surface_t(detail::surface_t{Cairo::PsSurface::create(filename, width, height)})
+{
+    Cairo::RefPtr<Cairo::PsSurface>::cast_static(_surface->surface)->set_eps(eps);
+    if (eps)
+        _surface->pages_left = 1;
+}
+
+
+// cairo spools PostScript pages until finish(), there is nothing to flush per page
+ps_surface_t::ps_surface_t(std::ostream& out, double width, double height, bool eps)
+    : surface_t(detail::surface_t{Cairo::PsSurface::create_for_stream(detail::write_to(out), width, height)})
+{
+    Cairo::RefPtr<Cairo::PsSurface>::cast_static(_surface->surface)->set_eps(eps);
+    if (eps)
+        _surface->pages_left = 1;
+}
+
+
+ps_surface_t::~ps_surface_t()
+{
+    if (_surface)
+        (*_surface)->finish();
+}
+
+
+void ps_surface_t::page_size(double width, double height)
+{
+    Cairo::RefPtr<Cairo::PsSurface>::cast_static(_surface->surface)->set_size(width, height);
+}
+
+
+glyph_atlas_t::glyph_atlas_t(double max_size, std::size_t max_pages)
+    : _atlas(new detail::glyph_atlas_t(max_size, std::max<std::size_t>(max_pages, 1)))
+{
+}
+
+
+glyph_atlas_t::~glyph_atlas_t()
+{}
+
+
+std::size_t glyph_atlas_t::glyph_count() const
+{
+    return _atlas->entries.size();
+}
+
+
+std::size_t glyph_atlas_t::page_count() const
+{
+    return _atlas->pages.size();
+}
+
+
+layer_stack_t::layer_stack_t(double width, double height)
+    : _width(width)
+    , _height(height)
+{
+}
+
+
+std::size_t layer_stack_t::add_layer(render_function render, double opacity, Operator op)
+{
+    _layers.push_back(layer_t{
+        image_surface_t(Format::FORMAT_ARGB32, _width, _height),
+        std::move(render),
+        opacity,
+        op,
+        false});
+    return _layers.size() - 1;
+}
+
+
+void layer_stack_t::invalidate(std::size_t layer)
+{
+    _layers.at(layer).valid = false;
+}
+
+
+void layer_stack_t::invalidate_all()
+{
+    for (auto& layer: _layers)
+    {
+        layer.valid = false;
+    }
+}
+
+
+void layer_stack_t::composite_onto(surface_t& target)
+{
+    detail::context_t context(*target._surface);
+    for (auto& layer: _layers)
+    {
+        if (!layer.valid)
+        {
+            detail::context_t clear(*layer.surface._surface);
+            clear->set_operator(Operator::OPERATOR_CLEAR);
+            clear->paint();
+            layer.render(layer.surface);
+            layer.valid = true;
+        }
+        context->set_source(layer.surface._surface->surface, 0, 0);
+        context->set_operator(layer.op);
+        context->paint_with_alpha(layer.opacity);
+    }
+}
+
+
+command_buffer_t::command_buffer_t()
+    : _buffer(new detail::command_buffer_t)
+{
+}
+
+
+command_buffer_t::command_buffer_t(command_buffer_t&& other)
+    : _buffer(std::move(other._buffer))
+{}
+
+
+command_buffer_t& command_buffer_t::operator=(command_buffer_t&& other)
+{
+    _buffer = std::move(other._buffer);
+    return *this;
+}
+
+
+command_buffer_t::~command_buffer_t()
+{}
+
+
+void command_buffer_t::fill(const color_t& color)
+{
+    _buffer->add(detail::command_buffer_t::op_t::paint, color);
+}
+
+
+void command_buffer_t::fill(const color_t& color, const path_base_t& path)
+{
+    auto& context = _buffer->scratch_context();
+    path.apply_to_context(context);
+    std::unique_ptr<Cairo::Path> copy(context->copy_path());
+    _buffer->add_segments(_buffer->add(detail::command_buffer_t::op_t::fill, color), *copy->cobj());
+}
+
+
+void command_buffer_t::stroke(const pen_t& pen, const path_base_t& path)
+{
+    auto& context = _buffer->scratch_context();
+    path.apply_to_context(context);
+    std::unique_ptr<Cairo::Path> copy(context->copy_path());
+    _buffer->add_segments(_buffer->add(detail::command_buffer_t::op_t::stroke, pen.color(), pen.width()), *copy->cobj());
+}
+
+
+void command_buffer_t::print(const font_t& font, const pos_t& pos, const std::string& text)
+{
+    auto& command = _buffer->add(detail::command_buffer_t::op_t::print, font.color(), font.size(), pos);
+    command.text = static_cast<std::uint32_t>(_buffer->texts.size());
+    // only the cairo face is referenced, the font's RefPtr is not copied
+    command.face = _buffer->add_face(font.font_face()._font_face->font_face->cobj());
+    _buffer->texts.push_back(text);
+}
+
+
+std::size_t command_buffer_t::size() const
+{
+    return _buffer->commands.size();
+}
+
+
+void command_buffer_t::clear()
+{
+    _buffer->commands.clear();
+    _buffer->segments.clear();
+    _buffer->points.clear();
+    _buffer->texts.clear();
+    _buffer->faces.clear();
+    _buffer->key = 0;
+}
+
+
+void command_buffer_t::sort_key(std::uint64_t key)
+{
+    _buffer->key = key;
+}
+
+
+std::uint64_t command_buffer_t::sort_key() const
+{
+    return _buffer->key;
+}
+
+
+command_buffer_t command_buffer_t::merge(const std::vector<command_buffer_t>& buffers)
+{
+    std::vector<const detail::command_buffer_t*> details;
+    details.reserve(buffers.size());
+    for (const auto& buffer: buffers)
+    {
+        details.push_back(buffer._buffer.get());
+    }
+    command_buffer_t result;
+    detail::merge(details, *result._buffer);
+    return result;
+}
+
+
+void command_buffer_t::replay(surface_t& surface) const
+{
+    using op_t = detail::command_buffer_t::op_t;
+    const auto& buffer = *_buffer;
+    // one font per face, color and size are set for each print
+    std::vector<font_t> fonts;
+    fonts.reserve(buffer.faces.size());
+    for (const auto& face: buffer.faces)
+    {
+        fonts.emplace_back(detail::recorded_font_face_t(face.font_face()), color_t(0, 0, 0), 0);
+    }
+    for (const auto& command: buffer.commands)
+    {
+        switch (command.op)
+        {
+        case op_t::paint:
+            surface.fill(command.color);
+            break;
+        case op_t::fill:
+            surface.fill(command.color, detail::recorded_path_t(buffer, command));
+            break;
+        case op_t::stroke:
+            surface.stroke(pen_t(command.color, command.size), detail::recorded_path_t(buffer, command));
+            break;
+        case op_t::print:
+        {
+            auto& font = fonts[command.face];
+            font.color(command.color);
+            font.size(command.size);
+            surface.print(font, command.pos, buffer.texts[command.text]);
+            break;
+        }
+        }
+    }
+}
+
+
+std::string command_buffer_t::serialize() const
+{
+    const auto& buffer = *_buffer;
+    std::string out;
+    out.reserve(64 + buffer.commands.size() * 80 + buffer.segments.size() + buffer.points.size() * sizeof(double));
+    detail::write_value(out, buffer.magic);
+    detail::write_value(out, buffer.version);
+    detail::write_value(out, static_cast<std::uint32_t>(buffer.commands.size()));
+    for (const auto& command: buffer.commands)
+    {
+        detail::write_value(out, command.op);
+        for (double value: {command.color.red(), command.color.green(), command.color.blue(), command.color.alpha(),
+                command.size, command.pos.x(), command.pos.y()})
+        {
+            detail::write_value(out, value);
+        }
+        for (auto value: {command.segment, command.segments, command.point, command.text, command.face})
+        {
+            detail::write_value(out, value);
+        }
+        detail::write_value(out, command.key);
+    }
+    detail::write_value(out, static_cast<std::uint32_t>(buffer.segments.size()));
+    out.append(reinterpret_cast<const char*>(buffer.segments.data()), buffer.segments.size());
+    detail::write_value(out, static_cast<std::uint32_t>(buffer.points.size()));
+    out.append(reinterpret_cast<const char*>(buffer.points.data()), buffer.points.size() * sizeof(double));
+    detail::write_value(out, static_cast<std::uint32_t>(buffer.texts.size()));
+    for (const auto& text: buffer.texts)
+    {
+        detail::write_string(out, text);
+    }
+    detail::write_value(out, static_cast<std::uint32_t>(buffer.faces.size()));
+    for (const auto& face: buffer.faces)
+    {
+        if (cairo_font_face_get_type(face.get()) != CAIRO_FONT_TYPE_TOY)
+            throw std::invalid_argument("only toy font faces can be serialized");
+        detail::write_string(out, cairo_toy_font_face_get_family(face.get()));
+        detail::write_value(out, static_cast<std::uint32_t>(cairo_toy_font_face_get_slant(face.get())));
+        detail::write_value(out, static_cast<std::uint32_t>(cairo_toy_font_face_get_weight(face.get())));
+    }
+    return out;
+}
+
+
+command_buffer_t command_buffer_t::deserialize(const void* data, std::size_t size)
+{
+    detail::byte_reader_t in(data, size);
+    if (in.read<std::uint32_t>() != detail::command_buffer_t::magic)
+        throw std::runtime_error("not a command buffer");
+    if (in.read<std::uint32_t>() != detail::command_buffer_t::version)
+        throw std::runtime_error("unsupported command buffer version");
+
+    command_buffer_t result;
+    auto& buffer = *result._buffer;
+    const auto count = in.read<std::uint32_t>();
+    constexpr std::size_t command_size = 1 + 7 * sizeof(double) + 5 * sizeof(std::uint32_t) + sizeof(std::uint64_t);
+    if (count > size / command_size)
+        throw std::runtime_error("truncated command buffer");
+    buffer.commands.reserve(count);
+    for (std::uint32_t i = 0; i < count; ++i)
+    {
+        const auto op = in.read<detail::command_buffer_t::op_t>();
+        double values[7];
+        for (double& value: values)
+        {
+            value = in.read<double>();
+        }
+        std::uint32_t indices[5];
+        for (auto& index: indices)
+        {
+            index = in.read<std::uint32_t>();
+        }
+        buffer.commands.push_back(detail::command_buffer_t::command_t{
+            op, color_t(values[0], values[1], values[2], values[3]), values[4], pos_t(values[5], values[6]),
+            indices[0], indices[1], indices[2], indices[3], indices[4], in.read<std::uint64_t>()});
+    }
+    in.read_array(buffer.segments);
+    in.read_array(buffer.points);
+    const auto texts = in.read<std::uint32_t>();
+    for (std::uint32_t i = 0; i < texts; ++i)
+    {
+        buffer.texts.push_back(in.read_string());
+    }
+    const auto faces = in.read<std::uint32_t>();
+    for (std::uint32_t i = 0; i < faces; ++i)
+    {
+        const auto family = in.read_string();
+        const auto slant = in.read<std::uint32_t>();
+        const auto weight = in.read<std::uint32_t>();
+        if (slant > Cairo::FONT_SLANT_OBLIQUE || weight > Cairo::FONT_WEIGHT_BOLD)
+            throw std::runtime_error("invalid command buffer font");
+        buffer.faces.emplace_back(Cairo::ToyFontFace::create(family, FontSlant(slant), FontWeight(weight))->cobj());
+    }
+    buffer.validate();
+    return result;
+}
+
+
+scene_recorder_t::scene_recorder_t()
+    : _recorder(new detail::scene_recorder_t)
+{
+}
+
+
+scene_recorder_t::~scene_recorder_t()
+{}
+
+
+command_buffer_t& scene_recorder_t::buffer(std::size_t slot)
+{
+    std::lock_guard<std::mutex> lock(_recorder->mutex);
+    auto& buffers = _recorder->buffers;
+    if (slot >= buffers.size())
+        buffers.resize(slot + 1);
+    if (!buffers[slot])
+        buffers[slot].reset(new command_buffer_t);
+    return *buffers[slot];
+}
+
+
+command_buffer_t scene_recorder_t::merge() const
+{
+    std::lock_guard<std::mutex> lock(_recorder->mutex);
+    std::vector<const detail::command_buffer_t*> details;
+    details.reserve(_recorder->buffers.size());
+    for (const auto& buffer: _recorder->buffers)
+    {
+        if (buffer)
+            details.push_back(buffer->_buffer.get());
+    }
+    command_buffer_t result;
+    detail::merge(details, *result._buffer);
+    return result;
+}
+
+
+void scene_recorder_t::submit(surface_t& surface) const
+{
+    merge().replay(surface);
+}
+
+
+void scene_recorder_t::clear()
+{
+    std::lock_guard<std::mutex> lock(_recorder->mutex);
+    for (auto& buffer: _recorder->buffers)
+    {
+        if (buffer)
+            buffer->clear();
+    }
+}
+
+
+void linear_gradient_t::apply_to_context(detail::context_t& context) const
+{
+    auto gradient = Cairo::LinearGradient::create(_start.x(), _start.y(), _end.x(), _end.y());
+    detail::add_color_stops(gradient, *this);
+    context->set_source(gradient);
+}
+
+
+void radial_gradient_t::apply_to_context(detail::context_t& context) const
+{
+    auto gradient = Cairo::RadialGradient::create(
+        _center_start.x(), _center_start.y(), _radius_start,
+        _center_end.x(), _center_end.y(), _radius_end);
+    detail::add_color_stops(gradient, *this);
+    context->set_source(gradient);
+}
+
+
 void line_t::apply_to_context(detail::context_t &context) const
 {
     context->move_to(_start.x(), _start.y());
@@ -159,4 +1970,137 @@ void arc_t::apply_to_context(detail::context_t& context) const
 }
 
 
+void grid_t::apply_to_context(detail::context_t& context) const
+{
+    for (int column = 0; _columns > 0 && column <= _columns; ++column)
+    {
+        const double x = _corner.x() + _width * column / _columns;
+        context->move_to(x, _corner.y());
+        context->line_to(x, _corner.y() + _height);
+    }
+    for (int row = 0; _rows > 0 && row <= _rows; ++row)
+    {
+        const double y = _corner.y() + _height * row / _rows;
+        context->move_to(_corner.x(), y);
+        context->line_to(_corner.x() + _width, y);
+    }
+}
+
+
+void ticks_t::apply_to_context(detail::context_t& context) const
+{
+    const double dx = _end.x() - _start.x();
+    const double dy = _end.y() - _start.y();
+    const double axis = std::hypot(dx, dy);
+    if (_count < 0 || axis == 0)
+        return;
+    // left of the axis as seen on screen, where y points down
+    const double nx = dy / axis * _length;
+    const double ny = -dx / axis * _length;
+    for (int i = 0; i <= _count; ++i)
+    {
+        const double t = _count > 0 ? double(i) / _count : 0;
+        const double x = _start.x() + t * dx;
+        const double y = _start.y() + t * dy;
+        context->move_to(x, y);
+        context->line_to(x + nx, y + ny);
+    }
+}
+
+
+void regular_polygon_t::apply_to_context(detail::context_t& context) const
+{
+    if (_sides < 3)
+        return;
+    for (int i = 0; i < _sides; ++i)
+    {
+        const double angle = _angle + 2 * M_PI * i / _sides;
+        const double x = _center.x() + _radius * std::cos(angle);
+        const double y = _center.y() + _radius * std::sin(angle);
+        if (i == 0)
+            context->move_to(x, y);
+        else
+            context->line_to(x, y);
+    }
+    context->close_path();
+}
+
+
+void function_plot_t::apply_to_context(detail::context_t& context) const
+{
+    if (!_f || _width <= 0 || _y_max == _y_min)
+        return;
+    // one sample per device pixel whatever the transformation
+    double device_x = _width;
+    double device_y = 0;
+    context->user_to_device_distance(device_x, device_y);
+    const int samples = std::max(2, static_cast<int>(std::ceil(std::hypot(device_x, device_y))) + 1);
+
+    // positions are 0 at the top of the rectangle and 1 at the bottom; the
+    // line between two samples is clipped to the rectangle, so it ends and
+    // starts again where the curve crosses y_min or y_max
+    auto point = [&](double t, double position)
+    {
+        return std::make_pair(_corner.x() + t * _width, _corner.y() + _height * position);
+    };
+    bool drawing = false;
+    bool previous = false;
+    double t0 = 0;
+    double p0 = 0;
+    for (int i = 0; i < samples; ++i)
+    {
+        const double t1 = double(i) / (samples - 1);
+        const double value = _f(_x_start + t1 * (_x_end - _x_start));
+        const double p1 = (_y_max - value) / (_y_max - _y_min);
+        if (!std::isfinite(value))
+        {
+            drawing = previous = false;
+            continue;
+        }
+        // from above the rectangle straight to below it or back is a pole,
+        // not a steep slope
+        const bool pole = (p0 < 0 && p1 > 1) || (p0 > 1 && p1 < 0);
+        if (previous && !pole)
+        {
+            // the part of the segment inside, as fractions a..b of it
+            double a = 0;
+            double b = 1;
+            if (p1 != p0)
+            {
+                const double top = -p0 / (p1 - p0);
+                const double bottom = (1 - p0) / (p1 - p0);
+                a = std::max(a, std::min(top, bottom));
+                b = std::min(b, std::max(top, bottom));
+            }
+            else if (p0 < 0 || p0 > 1)
+            {
+                b = -1;
+            }
+            if (a <= b)
+            {
+                if (!drawing || a > 0)
+                {
+                    const auto start = point(t0 + a * (t1 - t0), p0 + a * (p1 - p0));
+                    context->move_to(start.first, start.second);
+                }
+                const auto end = point(t0 + b * (t1 - t0), p0 + b * (p1 - p0));
+                context->line_to(end.first, end.second);
+                drawing = b == 1;
+            }
+            else
+            {
+                drawing = false;
+            }
+        }
+        else
+        {
+            drawing = false;
+        }
+        previous = true;
+        t0 = t1;
+        p0 = p1;
+    }
+}
+
+
 }
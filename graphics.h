@@ -1,22 +1,97 @@
+#pragma once
 #include <cairomm/enums.h>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
 #include <string>
 #include <vector>
 #include <memory>
+#include <memory_resource>
 
 
 namespace graphics2 {
 
 
 namespace detail {
+    struct apng_writer_t;
+    struct command_buffer_t;
     struct context_t;
     struct font_face_t;
+    struct glyph_atlas_t;
+    struct scene_recorder_t;
     struct surface_t;
+
+    // the size and alignment make_in allocated for an object
+    struct allocation_t
+    {
+        std::size_t size;
+        std::size_t alignment;
+    };
+
+    // destroys an object created by make_in and gives its memory back to the
+    // resource it came from; the object itself knows what was allocated, so
+    // only the resource is kept next to every pointer
+    class resource_deleter_t
+    {
+    public:
+        resource_deleter_t() = default;
+        explicit resource_deleter_t(std::pmr::memory_resource* resource)
+            : _resource(resource)
+        {}
+
+        template<typename T>
+        void operator()(T* object) const
+        {
+            const auto allocation = object->allocation();
+            void* memory = dynamic_cast<void*>(object);
+            object->~T();
+            _resource->deallocate(memory, allocation.size, allocation.alignment);
+        }
+
+    private:
+        std::pmr::memory_resource* _resource = nullptr;
+    };
+
+    template<typename T>
+    using resource_ptr = std::unique_ptr<T, resource_deleter_t>;
+
+    // what make_in really creates, T with its allocation filled in
+    template<typename T>
+    class allocated_t final : public T
+    {
+    public:
+        template<typename... ARGS>
+        explicit allocated_t(ARGS&&... args)
+            : T(std::forward<ARGS>(args)...)
+        {}
+
+    private:
+        allocation_t allocation() const override { return {sizeof(allocated_t), alignof(allocated_t)}; }
+    };
+
+    template<typename T, typename... ARGS>
+    resource_ptr<T> make_in(std::pmr::memory_resource* resource, ARGS&&... args)
+    {
+        using object_t = allocated_t<T>;
+        void* memory = resource->allocate(sizeof(object_t), alignof(object_t));
+        try
+        {
+            return resource_ptr<T>(new (memory) object_t(std::forward<ARGS>(args)...), resource_deleter_t(resource));
+        }
+        catch (...)
+        {
+            resource->deallocate(memory, sizeof(object_t), alignof(object_t));
+            throw;
+        }
+    }
 }
 
 
 using Format = Cairo::Format;
 using FontSlant = Cairo::FontSlant;
 using FontWeight = Cairo::FontWeight;
+using Operator = Cairo::Operator;
+using Filter = Cairo::Filter;
 
 
 class color_t
@@ -88,9 +163,85 @@ public:
     virtual ~path_base_t() {}
 
 private:
+    friend class command_buffer_t;
     friend class path_t;
     friend class surface_t;
+    friend class detail::resource_deleter_t;
     virtual void apply_to_context(detail::context_t&) const = 0;
+    // overridden for paths created in a memory resource
+    virtual detail::allocation_t allocation() const { return {sizeof(path_base_t), alignof(path_base_t)}; }
+};
+
+
+class pattern_base_t
+{
+public:
+    virtual ~pattern_base_t() {}
+
+private:
+    friend class surface_t;
+    virtual void apply_to_context(detail::context_t&) const = 0;
+};
+
+
+class gradient_t : public pattern_base_t
+{
+public:
+    struct color_stop_t
+    {
+        double offset;
+        color_t color;
+    };
+
+    gradient_t& add_color_stop(double offset, const color_t& color)
+    {
+        _stops.push_back(color_stop_t{offset, color});
+        return *this;
+    }
+
+    const std::vector<color_stop_t>& color_stops() const { return _stops; }
+
+private:
+    std::vector<color_stop_t> _stops;
+};
+
+
+class linear_gradient_t : public gradient_t
+{
+public:
+    linear_gradient_t(pos_t start, pos_t end)
+        : _start(start)
+        , _end(end)
+    {}
+
+private:
+    void apply_to_context(detail::context_t&) const override;
+
+    pos_t _start;
+    pos_t _end;
+};
+
+
+class radial_gradient_t : public gradient_t
+{
+public:
+    radial_gradient_t(pos_t center, double radius)
+        : radial_gradient_t(center, 0, center, radius)
+    {}
+    radial_gradient_t(pos_t center_start, double radius_start, pos_t center_end, double radius_end)
+        : _center_start(center_start)
+        , _radius_start(radius_start)
+        , _center_end(center_end)
+        , _radius_end(radius_end)
+    {}
+
+private:
+    void apply_to_context(detail::context_t&) const override;
+
+    pos_t _center_start;
+    double _radius_start;
+    pos_t _center_end;
+    double _radius_end;
 };
 
 
@@ -104,8 +255,12 @@ protected:
     explicit font_face_t(detail::font_face_t);
     std::unique_ptr<detail::font_face_t> _font_face;
 private:
+    friend class command_buffer_t;
     friend class surface_t;
+    friend class detail::resource_deleter_t;
     void apply_to_context(detail::context_t&) const;
+    // overridden for font faces created in a memory resource
+    virtual detail::allocation_t allocation() const { return {sizeof(font_face_t), alignof(font_face_t)}; }
 };
 
 
@@ -120,8 +275,12 @@ class font_t
 {
 public:
     template<typename FontFace>
-    font_t(FontFace&& font_face, color_t color, double size)
-        : _font_face(new std::decay_t<FontFace>(std::forward<FontFace>(font_face)))
+    font_t(
+            FontFace&& font_face,
+            color_t color,
+            double size,
+            std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : _font_face(detail::make_in<std::decay_t<FontFace>>(resource, std::forward<FontFace>(font_face)))
         , _color(std::move(color))
         , _size(size)
     {}
@@ -133,26 +292,84 @@ public:
     void size(double s) { _size = s; }
 
 private:
-    std::unique_ptr<font_face_t> _font_face;
+    detail::resource_ptr<font_face_t> _font_face;
     color_t _color;
     double _size;
 };
 
 
+// Trades rendering quality for speed, applied to every drawing operation of a
+// surface: fast uses coarse antialiasing, curve flattening and hinted text,
+// best the finest of each, good is cairo's default.
+enum class quality_t
+{
+    fast,
+    good,
+    best,
+};
+
+
+// Rasterizes every glyph printed on image surfaces once per face, size,
+// quarter pixel offset and surface quality into A8 pages, later prints blend
+// the cached coverage.
+// Fonts above max_size and other surfaces keep using cairo. The atlas holds
+// at most max_pages 1024x1024 pages and starts over when it would need more.
+// Share one atlas between the image surfaces that print with the same fonts,
+// from one thread.
+class glyph_atlas_t
+{
+public:
+    explicit glyph_atlas_t(double max_size=32, std::size_t max_pages=16);
+    ~glyph_atlas_t();
+
+    std::size_t glyph_count() const;
+    std::size_t page_count() const;
+
+private:
+    friend class surface_t;
+    std::unique_ptr<detail::glyph_atlas_t> _atlas;
+};
+
+
+class image_surface_t;
+
+
 class surface_t
 {
 public:
+    surface_t(surface_t&&);
     virtual ~surface_t();
     void show_page();
 
+    void quality(quality_t);
+    quality_t quality() const;
+
     void fill(const color_t&);
     void fill(const color_t&, const path_base_t&);
+    void fill(const pattern_base_t&);
+    void fill(const pattern_base_t&, const path_base_t&);
     void stroke(const pen_t&, const path_base_t&);
     void print(const font_t&, const pos_t&, const std::string&);
 
+    // Draws a whole raster into the rectangle at pos with the given size in
+    // one operation, scaling with the filter (FILTER_NEAREST, FILTER_BILINEAR, ...).
+    // The pixels are used in place, they must be in the given cairo format.
+    void draw_image(const image_surface_t&, const pos_t&, double width, double height, Filter=Filter::FILTER_BILINEAR);
+    void draw_pixels(
+        const unsigned char* data, Format, int columns, int rows, int stride,
+        const pos_t&, double width, double height, Filter=Filter::FILTER_BILINEAR);
+
+    // Composites the source with its top left corner at pos. OPERATOR_OVER,
+    // OPERATOR_SOURCE, OPERATOR_ADD and OPERATOR_MULTIPLY between image
+    // surfaces of the same ARGB32, RGB24 or A8 format at whole pixel positions
+    // use SSE2 kernels, anything else is left to cairo.
+    void composite(const image_surface_t&, const pos_t&, Operator=Operator::OPERATOR_OVER);
+
 protected:
     explicit surface_t(detail::surface_t);
     std::unique_ptr<detail::surface_t> _surface;
+private:
+    friend class layer_stack_t;
 };
 
 
@@ -160,7 +377,64 @@ class image_surface_t: public surface_t
 {
 public:
     image_surface_t(Format, double width, double height);
+    // renders into pixels owned by the caller, which must outlive the surface
+    image_surface_t(unsigned char* data, Format, int width, int height, int stride);
+    static image_surface_t from_png(const std::string& filename);
+    static int stride_for_width(Format, int width);
     void write_to_png(const std::string& filename);
+
+    // print() goes through the atlas for the sizes it covers
+    void glyph_atlas(std::shared_ptr<glyph_atlas_t>);
+
+    // direct pixel access, call flush() before touching data() and
+    // mark_dirty() when done so cairo picks up the changes
+    Format format() const;
+    int width() const;
+    int height() const;
+    int stride() const;
+    unsigned char* data();
+    const unsigned char* data() const;
+    void flush() const;
+    void mark_dirty();
+
+    // Successively halved copies of this surface, levels[0] being half the
+    // size of this one. Every level is box filtered from the previous one, so
+    // the full size pixels are only read once. Cairo stores premultiplied
+    // alpha, which is what makes a plain average correct.
+    std::vector<image_surface_t> mipmaps(std::size_t levels) const;
+
+private:
+    explicit image_surface_t(detail::surface_t);
+};
+
+
+struct image_difference_t
+{
+    bool size_mismatch = false;
+    std::size_t differing_pixels = 0;
+    // perceptual distance between 0 and 1 of the most different pixel
+    double max_delta = 0;
+};
+
+
+// Compares two ARGB32 or RGB24 surfaces pixel by pixel. Identical runs are
+// skipped four pixels at a time, differing pixels are measured in YIQ space
+// weighted like the eye, and count when their delta is above threshold. With
+// a heatmap of the same size it receives a faded copy of expected with the
+// differences in red (above threshold) and yellow (below).
+image_difference_t compare_images(
+    const image_surface_t& expected,
+    const image_surface_t& actual,
+    double threshold = 0.1,
+    image_surface_t* heatmap = nullptr);
+
+
+struct svg_options_t
+{
+    // decimals kept in coordinates, negative keeps cairo's full precision
+    int precision = -1;
+    // share repeated identical shapes through <defs> and <use>
+    bool deduplicate = false;
 };
 
 
@@ -168,6 +442,177 @@ class svg_surface_t: public surface_t
 {
 public:
     svg_surface_t(const std::string& filename, double width, double height);
+    svg_surface_t(const std::string& filename, double width, double height, const svg_options_t&);
+    // the stream must outlive the surface, the document is complete once the
+    // surface is destroyed
+    svg_surface_t(std::ostream&, double width, double height, const svg_options_t& = svg_options_t());
+    svg_surface_t(svg_surface_t&&) = default;
+    ~svg_surface_t();
+};
+
+
+// Multi page document, call show_page() after each page. The stream
+// variant flushes the stream after every page; the stream must outlive the
+// surface and the document is complete once the surface is destroyed.
+class pdf_surface_t: public surface_t
+{
+public:
+    pdf_surface_t(const std::string& filename, double width, double height);
+    pdf_surface_t(std::ostream&, double width, double height);
+    pdf_surface_t(pdf_surface_t&&) = default;
+    ~pdf_surface_t();
+
+    // size of the pages from the next one on
+    void page_size(double width, double height);
+};
+
+
+// Multi page document like pdf_surface_t, except that cairo keeps all pages
+// until the end: nothing is written before the surface is destroyed. An EPS
+// document has a single page, show_page() throws std::logic_error after it.
+class ps_surface_t: public surface_t
+{
+public:
+    ps_surface_t(const std::string& filename, double width, double height, bool eps=false);
+    ps_surface_t(std::ostream&, double width, double height, bool eps=false);
+    ps_surface_t(ps_surface_t&&) = default;
+    ~ps_surface_t();
+
+    // size of the pages from the next one on
+    void page_size(double width, double height);
+};
+
+
+// A stack of layers that are each rendered into their own cached surface and
+// composited in order. A layer is only re-rendered after it is invalidated,
+// so a static background costs nothing once it has been drawn.
+class layer_stack_t
+{
+public:
+    using render_function = std::function<void(surface_t&)>;
+
+    layer_stack_t(double width, double height);
+
+    std::size_t add_layer(render_function, double opacity=1, Operator=Operator::OPERATOR_OVER);
+    std::size_t size() const { return _layers.size(); }
+
+    void invalidate(std::size_t layer);
+    void invalidate_all();
+    bool is_valid(std::size_t layer) const { return _layers.at(layer).valid; }
+
+    // opacity and operator are applied while compositing, changing them
+    // does not invalidate the layer
+    double opacity(std::size_t layer) const { return _layers.at(layer).opacity; }
+    void opacity(std::size_t layer, double opacity) { _layers.at(layer).opacity = opacity; }
+    Operator blend_operator(std::size_t layer) const { return _layers.at(layer).op; }
+    void blend_operator(std::size_t layer, Operator op) { _layers.at(layer).op = op; }
+
+    void composite_onto(surface_t&);
+
+private:
+    struct layer_t
+    {
+        image_surface_t surface;
+        render_function render;
+        double opacity;
+        Operator op;
+        bool valid;
+    };
+
+    double _width;
+    double _height;
+    std::vector<layer_t> _layers;
+};
+
+
+// Writes frames to an animated PNG. Every frame after the first only encodes
+// the rectangle that changed since the previous one, and encoding runs on a
+// background thread so the next frame can be rendered in the meantime.
+// All frames must have the size and format (ARGB32 or RGB24) of the first.
+class apng_writer_t
+{
+public:
+    apng_writer_t(const std::string& filename, unsigned delay_ms, unsigned plays=0);
+    apng_writer_t(apng_writer_t&&);
+    ~apng_writer_t();
+
+    void add_frame(const image_surface_t&);
+    void add_frame(const image_surface_t&, unsigned delay_ms);
+    // waits for the queued frames and completes the file, also done by the
+    // destructor but that cannot report errors; without any frames the file
+    // is removed and finish() throws std::logic_error
+    void finish();
+
+private:
+    std::unique_ptr<detail::apng_writer_t> _writer;
+};
+
+
+// Drawing commands recorded for replaying them on a surface later. Paths are
+// stored as the segments cairo makes of them, so arcs become curves and any
+// path type can be recorded. serialize() turns the buffer into bytes for
+// another process, which only works for toy font faces.
+class command_buffer_t
+{
+public:
+    command_buffer_t();
+    command_buffer_t(command_buffer_t&&);
+    command_buffer_t& operator=(command_buffer_t&&);
+    ~command_buffer_t();
+
+    void fill(const color_t&);
+    void fill(const color_t&, const path_base_t&);
+    void stroke(const pen_t&, const path_base_t&);
+    void print(const font_t&, const pos_t&, const std::string&);
+
+    std::size_t size() const;
+    bool is_empty() const { return size() == 0; }
+    void clear();
+
+    // the key of the commands recorded from now on, 0 at first
+    void sort_key(std::uint64_t);
+    std::uint64_t sort_key() const;
+    // All commands of the buffers ordered by key. Equal keys keep the order
+    // of the buffers and the recording order within each, so buffers built
+    // in parallel merge into the scene one thread would have recorded.
+    static command_buffer_t merge(const std::vector<command_buffer_t>&);
+
+    void replay(surface_t&) const;
+
+    std::string serialize() const;
+    // throws std::runtime_error on malformed data
+    static command_buffer_t deserialize(const void* data, std::size_t size);
+
+private:
+    friend class scene_recorder_t;
+    std::unique_ptr<detail::command_buffer_t> _buffer;
+};
+
+
+// Builds one scene on several threads. Every thread records into the buffer
+// of its own slot, e.g. its index in a pool, setting a sort key per unit of
+// work, e.g. the z-order and index of a data series; submit() merges the
+// buffers by key and replays them. With a key for every unit the result does
+// not depend on which thread recorded what. Equal keys from different slots
+// are merged in slot order.
+class scene_recorder_t
+{
+public:
+    scene_recorder_t();
+    ~scene_recorder_t();
+
+    // the buffer of a slot, the same on every call with that slot; slots
+    // are not shared between threads that record at the same time
+    command_buffer_t& buffer(std::size_t slot);
+
+    // once the recording threads are done
+    command_buffer_t merge() const;
+    void submit(surface_t&) const;
+    // empties the buffers for the next scene and keeps their memory
+    void clear();
+
+private:
+    std::unique_ptr<detail::scene_recorder_t> _recorder;
 };
 
 
@@ -223,25 +668,35 @@ private:
 };
 
 
+// The parts of a path and the list holding them are allocated from a memory
+// resource, e.g. a std::pmr::monotonic_buffer_resource per frame that drops
+// all geometry at once. Like a pmr container, a path keeps its resource when
+// another one is moved into it; the moved parts stay where they were
+// allocated and must not outlive that resource.
 class path_t : public path_base_t
 {
 public:
     path_t() = default;
+    explicit path_t(std::pmr::memory_resource* resource)
+        : _parts(resource)
+    {}
     path_t(path_t&&) = default;
     path_t& operator=(path_t&&) = default;
 
-    template<typename Path>
-    explicit path_t(Path path)
+    template<typename Path, typename = std::enable_if_t<std::is_base_of<path_base_t, std::decay_t<Path>>::value>>
+    explicit path_t(Path path, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : path_t(resource)
     {
-        _parts.emplace_back(std::make_unique<Path>(std::forward<Path>(path)));
+        *this += std::move(path);
     }
 
     bool is_empty() const { return _parts.empty(); }
+    std::pmr::memory_resource* resource() const { return _parts.get_allocator().resource(); }
 
     template<typename Path>
     std::enable_if_t<std::is_base_of<path_base_t, std::decay_t<Path>>::value, path_t&> operator+=(Path&& path)
     {
-        _parts.emplace_back(new std::decay_t<Path>(std::forward<Path>(path)));
+        _parts.emplace_back(detail::make_in<std::decay_t<Path>>(resource(), std::forward<Path>(path)));
         return *this;
     }
 
@@ -255,7 +710,115 @@ private:
         }
     }
 
-    std::vector<std::unique_ptr<path_base_t>> _parts;
+    // the only record of the resource, so it cannot disagree with the list
+    std::pmr::vector<detail::resource_ptr<path_base_t>> _parts;
+    static_assert(sizeof(detail::resource_ptr<path_base_t>) == 2 * sizeof(void*), "a part is a pointer and its resource");
+};
+
+
+// Generated paths store only their parameters and emit every segment when
+// they are drawn, so their size does not grow with their detail.
+
+
+// columns + 1 vertical and rows + 1 horizontal lines dividing the rectangle
+class grid_t: public path_base_t
+{
+public:
+    grid_t(pos_t corner, double width, double height, int columns, int rows)
+        : _corner(corner)
+        , _width(width)
+        , _height(height)
+        , _columns(columns)
+        , _rows(rows)
+    {}
+
+private:
+    void apply_to_context(detail::context_t&) const override;
+
+    pos_t _corner;
+    double _width;
+    double _height;
+    int _columns;
+    int _rows;
+};
+
+
+// count + 1 evenly spaced tick marks from start to end, of the given length
+// and square to the axis, on its left for positive lengths
+class ticks_t: public path_base_t
+{
+public:
+    ticks_t(pos_t start, pos_t end, int count, double length)
+        : _start(start)
+        , _end(end)
+        , _count(count)
+        , _length(length)
+    {}
+
+private:
+    void apply_to_context(detail::context_t&) const override;
+
+    pos_t _start;
+    pos_t _end;
+    int _count;
+    double _length;
+};
+
+
+class regular_polygon_t: public path_base_t
+{
+public:
+    regular_polygon_t(pos_t center, double radius, int sides, double angle=0)
+        : _center(center)
+        , _radius(radius)
+        , _sides(sides)
+        , _angle(angle)
+    {}
+
+private:
+    void apply_to_context(detail::context_t&) const override;
+
+    pos_t _center;
+    double _radius;
+    int _sides;
+    double _angle;
+};
+
+
+// y = f(x) for x from x_start to x_end, scaled into the rectangle with
+// y_min at its bottom and y_max at its top. Sampled once per device pixel
+// of the rectangle's width. The line is clipped to the rectangle and breaks
+// where f is not finite or jumps from above the rectangle to below it, so
+// poles are not joined.
+class function_plot_t: public path_base_t
+{
+public:
+    using function = std::function<double(double)>;
+
+    function_plot_t(
+            function f, double x_start, double x_end, double y_min, double y_max,
+            pos_t corner, double width, double height)
+        : _f(std::move(f))
+        , _x_start(x_start)
+        , _x_end(x_end)
+        , _y_min(y_min)
+        , _y_max(y_max)
+        , _corner(corner)
+        , _width(width)
+        , _height(height)
+    {}
+
+private:
+    void apply_to_context(detail::context_t&) const override;
+
+    function _f;
+    double _x_start;
+    double _x_end;
+    double _y_min;
+    double _y_max;
+    pos_t _corner;
+    double _width;
+    double _height;
 };
 
 
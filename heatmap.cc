@@ -0,0 +1,83 @@
+#include "graphics.h"
+#include "colormap.h"
+#include "pixels.h"
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+
+// the field through the colormap with its legend, the lookup table and a
+// coarse sampling magnified
+void heatmap_scene(graphics2::image_surface_t& surface)
+{
+    using namespace graphics2;
+
+    constexpr auto colormap = make_colormap<256>(
+        pixel::color(0, 0, 0.5, 1),
+        pixel::color(0, 0.8, 1, 1),
+        pixel::color(1, 1, 0, 1),
+        pixel::color(0.8, 0, 0, 1));
+
+    const int width = surface.width();
+    const int height = surface.height();
+    std::vector<float> values(std::size_t(width) * height);
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            values[std::size_t(y) * width + x] = std::sin(x / 40.0) * std::cos(y / 30.0);
+        }
+    }
+    // NaN and values far out of range are clamped, in the bottom row the
+    // coarse sampling below does not read
+    values[values.size() - 1] = std::nanf("");
+    values[values.size() - 2] = 1e9f;
+    apply_colormap(colormap, values.data(), width, height, -1, 1, surface);
+
+    auto legend = linear_gradient_t(pos_t(20, 0), pos_t(width - 20, 0));
+    legend
+        .add_color_stop(0, color_t(0, 0, 0.5))
+        .add_color_stop(1.0 / 3, color_t(0, 0.8, 1))
+        .add_color_stop(2.0 / 3, color_t(1, 1, 0))
+        .add_color_stop(1, color_t(0.8, 0, 0));
+    surface.fill(legend, rectangle_t(pos_t(20, height - 40), pos_t(width - 40, 20)));
+
+    // the lookup table itself under the gradient, one raster blit
+    std::vector<std::uint32_t> table(colormap.size());
+    for (std::size_t i = 0; i < table.size(); ++i)
+    {
+        table[i] = colormap.argb32(i);
+    }
+    surface.draw_pixels(
+        reinterpret_cast<const unsigned char*>(table.data()), Format::FORMAT_ARGB32, int(table.size()), 1,
+        int(table.size() * sizeof(std::uint32_t)), pos_t(20, height - 20), width - 40, 10, Filter::FILTER_NEAREST);
+
+    // an 8 x 6 sampling of the field magnified, blocky and interpolated
+    std::vector<decltype(colormap)::entry> coarse;
+    for (int y = 0; y < 6; ++y)
+    {
+        for (int x = 0; x < 8; ++x)
+        {
+            const float value = values[(y * height / 6) * width + x * width / 8];
+            coarse.push_back(colormap[static_cast<std::size_t>((value + 1) / 2 * (colormap.size() - 1) + 0.5f)]);
+        }
+    }
+    surface.stroke(pen_t(color_t(1, 1, 1), 2), rectangle_t(pos_t(20, 20), pos_t(264, 96)));
+    draw_pixels(surface, coarse.data(), 8, 6, pos_t(20, 20), 128, 96, Filter::FILTER_NEAREST);
+    draw_pixels(surface, coarse.data(), 8, 6, pos_t(156, 20), 128, 96, Filter::FILTER_BILINEAR);
+}
+
+
+void heatmap()
+{
+    using namespace graphics2;
+
+    image_surface_t surface(Format::FORMAT_ARGB32, 600, 400);
+    heatmap_scene(surface);
+
+    std::string filename = "heatmap.png";
+    surface.write_to_png(filename);
+
+    std::cout << "Wrote png file \"" << filename << "\"" << std::endl;
+}
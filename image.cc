@@ -3,14 +3,11 @@
 #include <iostream>
 
 
-void image()
+// the scene of the image and svg demos
+void shapes_scene(graphics2::surface_t& surface, double width, double height)
 {
     using namespace graphics2;
 
-    auto width = 600;
-    auto height = 400;
-    image_surface_t surface(graphics2::Format::FORMAT_ARGB32, width, height);
-
     surface.fill(color_t(0.86, 0.85, 0.47));
 
     surface.stroke(pen_t(20), rectangle_t(pos_t(0, 0), pos_t(width, height)));
@@ -29,6 +26,17 @@ void image()
         line_t(
             pos_t(width / 4.0, height / 4.0),
             pos_t(width * 3.0 / 4.0, height * 3.0 / 4.0)));
+}
+
+
+void image()
+{
+    using namespace graphics2;
+
+    auto width = 600;
+    auto height = 400;
+    image_surface_t surface(graphics2::Format::FORMAT_ARGB32, width, height);
+    shapes_scene(surface, width, height);
 
     std::string filename = "image.png";
     surface.write_to_png(filename);
@@ -0,0 +1,45 @@
+#include "graphics.h"
+#include <chrono>
+#include <iostream>
+#include <memory>
+
+
+void labels()
+{
+    using namespace graphics2;
+    using clock = std::chrono::steady_clock;
+    using ms = std::chrono::duration<double, std::milli>;
+
+    auto width = 1200;
+    auto height = 800;
+    auto font = font_t(
+        toy_font_face_t("Bitstream Charter", FontSlant::FONT_SLANT_NORMAL, FontWeight::FONT_WEIGHT_NORMAL),
+        color_t(0.2, 0.2, 0.2),
+        10);
+
+    auto atlas = std::make_shared<glyph_atlas_t>();
+    for (bool cached: {false, true})
+    {
+        image_surface_t surface(Format::FORMAT_ARGB32, width, height);
+        surface.fill(color_t(1, 1, 1));
+        if (cached)
+            surface.glyph_atlas(atlas);
+
+        auto start = clock::now();
+        for (int i = 0; i < 10000; ++i)
+        {
+            surface.print(
+                font,
+                pos_t(width * ((i * 37) % 101) / 101.0, height * ((i * 53) % 97) / 97.0),
+                std::to_string(i * 0.25));
+        }
+        surface.flush();
+        auto time = clock::now() - start;
+
+        std::string filename = cached ? "labels-atlas.png" : "labels.png";
+        surface.write_to_png(filename);
+        std::cout << (cached ? "glyph atlas: " : "show_text: ") << ms(time).count() << " ms, wrote \""
+                  << filename << "\"" << std::endl;
+    }
+    std::cout << atlas->glyph_count() << " glyphs on " << atlas->page_count() << " atlas pages" << std::endl;
+}
@@ -0,0 +1,85 @@
+#include "graphics.h"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+
+// A static background, a chart that changes every tenth frame and a cursor
+// that moves every frame. Counts how often each layer is rendered; fading the
+// cursor and switching the chart's operator must not render either again.
+// Returns the number of failed checks.
+int layers()
+{
+    using namespace graphics2;
+    using clock = std::chrono::steady_clock;
+    using ms = std::chrono::duration<double, std::milli>;
+
+    auto width = 600;
+    auto height = 400;
+    const int frames = 60;
+
+    int renders[3] = {};
+    int frame = 0;
+    layer_stack_t stack(width, height);
+    const auto background = stack.add_layer([&](surface_t& surface)
+    {
+        ++renders[0];
+        surface.fill(color_t(0.95, 0.95, 0.9));
+        surface.stroke(pen_t(color_t(0, 0, 0, 0.1), 1), grid_t(pos_t(20, 20), width - 40, height - 40, 28, 18));
+    });
+    const auto chart = stack.add_layer([&](surface_t& surface)
+    {
+        ++renders[1];
+        const double phase = frame / 10 * 0.5;
+        surface.stroke(
+            pen_t(color_t(0.2, 0.4, 0.8), 2),
+            function_plot_t(
+                [phase](double x) { return std::sin(x + phase); },
+                0, 4 * M_PI, -1.2, 1.2, pos_t(20, 20), width - 40, height - 40));
+    });
+    const auto cursor = stack.add_layer([&](surface_t& surface)
+    {
+        ++renders[2];
+        const double x = 20 + (width - 40) * frame / double(frames);
+        surface.stroke(pen_t(color_t(0.8, 0.2, 0.2), 1), line_t(pos_t(x, 20), pos_t(x, height - 20)));
+    });
+
+    image_surface_t target(Format::FORMAT_ARGB32, width, height);
+    auto start = clock::now();
+    for (frame = 0; frame < frames; ++frame)
+    {
+        if (frame % 10 == 0)
+            stack.invalidate(chart);
+        stack.invalidate(cursor);
+        // applied while compositing, neither is rendered again for these
+        stack.opacity(cursor, 1 - 0.5 * frame / frames);
+        stack.blend_operator(chart, frame % 20 < 10 ? Operator::OPERATOR_OVER : Operator::OPERATOR_MULTIPLY);
+        stack.composite_onto(target);
+    }
+    target.flush();
+    auto time = clock::now() - start;
+
+    // and neither is a change after the last frame
+    stack.opacity(background, 0.5);
+    stack.blend_operator(cursor, Operator::OPERATOR_ADD);
+    const int before = renders[0] + renders[1] + renders[2];
+    stack.composite_onto(target);
+
+    std::string filename = "layers.png";
+    target.write_to_png(filename);
+    std::cout << frames << " frames: " << ms(time).count() << " ms, renders background: " << renders[0]
+              << ", chart: " << renders[1] << ", cursor: " << renders[2] << ", wrote \"" << filename << "\"" << std::endl;
+
+    int failures = 0;
+    if (renders[0] != 1 || renders[1] != frames / 10 || renders[2] != frames)
+    {
+        std::cout << "layers: FAILED, valid layers were rendered again" << std::endl;
+        ++failures;
+    }
+    if (renders[0] + renders[1] + renders[2] != before || !stack.is_valid(background) || !stack.is_valid(cursor))
+    {
+        std::cout << "layers: FAILED, changing opacity or operator rendered a layer" << std::endl;
+        ++failures;
+    }
+    return failures;
+}
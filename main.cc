@@ -1,5 +1,4 @@
 #include "graphics.h"
-#include <cmath>
 #include <iostream>
 
 
@@ -9,7 +8,6 @@ using namespace graphics2;
 const double HEIGHT = 200.0;
 const double WIDTH = 400.0;
 const double FONT_SIZE = 64.0;
-const pos_t text_origin(50, HEIGHT / 2.0 + FONT_SIZE / 2.0);
 const double GLYPH_SPACING = 0.1;
 
 
@@ -137,30 +135,20 @@ public:
 };
 
 
+// in text.cc
+void user_font_scene(surface_t& surface, const font_t& font);
+
+
 int main()
 {
 
     image_surface_t surface(Format::FORMAT_ARGB32, WIDTH, HEIGHT);
-    surface.fill(color_t(1.0, 1.0, 1.0));
-    surface.fill(
-        color_t(0.0, 1.0, 0.0, 0.5),
-        arc_t(text_origin, FONT_SIZE / 4.0, 0, 2*M_PI));
-
-    surface.print(
+    user_font_scene(
+        surface,
         font_t(
             box_font_face_t(),
             color_t(0.8, 0.2, 0.2),
-            FONT_SIZE),
-        text_origin,
-        "graphics2!");
-
-    surface.print(
-        font_t(
-            toy_font_face_t("Bitstream Charter", FontSlant::FONT_SLANT_NORMAL, FontWeight::FONT_WEIGHT_BOLD),
-            color_t(0.2, 0.2, 0.2, 0.3),
-            FONT_SIZE),
-        text_origin,
-        "graphics2!");
+            FONT_SIZE));
 
     const char* filename = "user-font.png";
     surface.write_to_png(filename);
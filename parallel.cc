@@ -0,0 +1,123 @@
+#include "graphics.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace {
+
+    // one data series of the scene and its label, keyed by its index so it
+    // lands in the same place of the scene whichever thread records it
+    void record_series(graphics2::command_buffer_t& buffer, const graphics2::font_t& font, int series, double width, double height)
+    {
+        using namespace graphics2;
+        buffer.sort_key(series);
+        const color_t color(0.5 + 0.5 * std::sin(series), 0.5 + 0.5 * std::cos(series), 0.6, 0.3);
+        for (int i = 0; i < 2000; ++i)
+        {
+            const double x = width * ((i * 7919 + series * 104729) % 10007) / 10007.0;
+            const double y = height * (0.5 + 0.4 * std::sin(x / width * 6 + series * 0.1) + 0.05 * std::cos(i));
+            buffer.fill(color, arc_t(pos_t(x, y), 3, 0, 2 * M_PI));
+        }
+        buffer.print(font, pos_t(10 + series % 8 * (width - 20) / 8, 20 + series / 8 * 14), "series " + std::to_string(series));
+    }
+
+
+    // every thread records into its own slot with the same font
+    void record_threaded(graphics2::scene_recorder_t& recorder, const graphics2::font_t& font, int threads, int series, double width, double height)
+    {
+        std::vector<std::thread> running;
+        for (int t = 0; t < threads; ++t)
+        {
+            // interleaved, so every thread records series all over the scene
+            running.emplace_back([&, t]()
+            {
+                auto& local = recorder.buffer(t);
+                for (int s = t; s < series; s += threads)
+                {
+                    record_series(local, font, s, width, height);
+                }
+            });
+        }
+        for (auto& thread: running)
+        {
+            thread.join();
+        }
+    }
+
+}
+
+
+// Records a scene on one thread and on several, twice with different thread
+// counts into the same recorder, and replays it from a serialized copy too.
+// Returns the number of results that differ from the serial one.
+int parallel()
+{
+    using namespace graphics2;
+    using clock = std::chrono::steady_clock;
+    using ms = std::chrono::duration<double, std::milli>;
+
+    auto width = 1200.0;
+    auto height = 800.0;
+    const int series = 64;
+    // shared by every recording thread
+    const font_t font(
+        toy_font_face_t("sans-serif", FontSlant::FONT_SLANT_NORMAL, FontWeight::FONT_WEIGHT_NORMAL),
+        color_t(0.1, 0.1, 0.1),
+        11);
+
+    image_surface_t serial(Format::FORMAT_ARGB32, width, height);
+    serial.fill(color_t(1, 1, 1));
+    auto start = clock::now();
+    command_buffer_t buffer;
+    for (int s = 0; s < series; ++s)
+    {
+        record_series(buffer, font, s, width, height);
+    }
+    auto recorded = clock::now();
+    buffer.replay(serial);
+    std::cout << "serial: recorded in " << ms(recorded - start).count() << " ms, replayed in "
+              << ms(clock::now() - recorded).count() << " ms" << std::endl;
+
+    int failures = 0;
+    auto check = [&](const image_surface_t& result, const char* what)
+    {
+        const auto difference = compare_images(serial, result, 0);
+        if (difference.differing_pixels != 0)
+        {
+            std::cout << "parallel: FAILED, " << difference.differing_pixels << " pixels differ " << what << std::endl;
+            ++failures;
+        }
+    };
+
+    scene_recorder_t recorder;
+    const int count = std::max(2u, std::thread::hardware_concurrency());
+    image_surface_t threaded(Format::FORMAT_ARGB32, width, height);
+    for (const int threads: {count, count / 2 + 1})
+    {
+        threaded.fill(color_t(1, 1, 1));
+        recorder.clear();
+        start = clock::now();
+        record_threaded(recorder, font, threads, series, width, height);
+        recorded = clock::now();
+        recorder.submit(threaded);
+        std::cout << threads << " threads: recorded in " << ms(recorded - start).count() << " ms, merged and replayed in "
+                  << ms(clock::now() - recorded).count() << " ms" << std::endl;
+        check(threaded, "recorded on threads");
+    }
+
+    // what a render server would replay
+    const auto bytes = recorder.merge().serialize();
+    image_surface_t deserialized(Format::FORMAT_ARGB32, width, height);
+    deserialized.fill(color_t(1, 1, 1));
+    command_buffer_t::deserialize(bytes.data(), bytes.size()).replay(deserialized);
+    check(deserialized, "after serializing");
+
+    threaded.write_to_png("parallel.png");
+    std::cout << "parallel: " << failures << " failed, wrote \"parallel.png\"" << std::endl;
+    return failures;
+}
@@ -0,0 +1,267 @@
+#pragma once
+#include "color.h"
+#include "graphics.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+
+namespace graphics2 {
+
+
+namespace detail {
+
+    // scales a channel of any width to 0..255, rounding to nearest
+    template<typename CHANNEL>
+    constexpr std::uint32_t to_8bit(const CHANNEL& channel)
+    {
+        if constexpr (std::is_integral<typename CHANNEL::type>::value)
+        {
+            const std::uint32_t range = channel.max() - channel.min();
+            return (static_cast<std::uint32_t>(channel.value() - channel.min()) * 255 + range / 2) / range;
+        }
+        else
+        {
+            return static_cast<std::uint32_t>((channel.value() - channel.min()) / (channel.max() - channel.min()) * 255 + 0.5);
+        }
+    }
+
+
+    // the inverse of to_8bit for integer channels, so that a stored value
+    // survives the trip through 8 bits; converting between channel types
+    // directly truncates and would not
+    template<typename CHANNEL>
+    constexpr CHANNEL from_8bit(std::uint32_t value)
+    {
+        const CHANNEL range(typename CHANNEL::type{});
+        const std::uint32_t width = range.max() - range.min();
+        return CHANNEL(static_cast<typename CHANNEL::type>((value * width + 127) / 255 + range.min()));
+    }
+
+}
+
+
+// premultiplied native endian pixel, as stored by FORMAT_ARGB32
+template<typename COLOR>
+constexpr std::uint32_t to_argb32(const COLOR& color)
+{
+    const std::uint32_t alpha = detail::to_8bit(color.alpha());
+    return
+        alpha << 24 |
+        (detail::to_8bit(color.red()) * alpha + 127) / 255 << 16 |
+        (detail::to_8bit(color.green()) * alpha + 127) / 255 << 8 |
+        (detail::to_8bit(color.blue()) * alpha + 127) / 255;
+}
+
+
+// Draws a columns x rows array of pixel::color_t values into the rectangle at
+// pos, converting once into an ARGB32 raster that is drawn in one operation.
+template<typename COLOR>
+void draw_pixels(
+    surface_t& surface,
+    const COLOR* pixels,
+    int columns,
+    int rows,
+    const pos_t& pos,
+    double width,
+    double height,
+    Filter filter=Filter::FILTER_BILINEAR)
+{
+    if (columns <= 0 || rows <= 0)
+        return;
+    image_surface_t image(Format::FORMAT_ARGB32, columns, rows);
+    image.flush();
+    auto* data = image.data();
+    const auto stride = image.stride();
+    for (int y = 0; y < rows; ++y)
+    {
+        const COLOR* in = pixels + static_cast<std::ptrdiff_t>(y) * columns;
+        auto* out = reinterpret_cast<std::uint32_t*>(data + static_cast<std::ptrdiff_t>(y) * stride);
+        for (int x = 0; x < columns; ++x)
+        {
+            out[x] = to_argb32(in[x]);
+        }
+    }
+    image.mark_dirty();
+    surface.draw_image(image, pos, width, height, filter);
+}
+
+
+
+// How a pixel::color_t layout is stored in a cairo image surface. pack and
+// unpack convert from and to a premultiplied ARGB32 word, every kernel below
+// is written in those terms and compiled once per layout.
+template<typename COLOR> struct pixel_traits;
+
+template<>
+struct pixel_traits<pixel::color_bits<8, 8, 8, 8>>
+{
+    using storage = std::uint32_t;
+    static constexpr Format format = Format::FORMAT_ARGB32;
+    static constexpr storage pack(std::uint32_t argb32) { return argb32; }
+    static constexpr std::uint32_t unpack(storage pixel) { return pixel; }
+};
+
+template<>
+struct pixel_traits<pixel::color_bits<8, 8, 8, 0>>
+{
+    using storage = std::uint32_t;
+    static constexpr Format format = Format::FORMAT_RGB24;
+    static constexpr storage pack(std::uint32_t argb32) { return argb32 & 0x00ffffffu; }
+    static constexpr std::uint32_t unpack(storage pixel) { return pixel | 0xff000000u; }
+};
+
+template<>
+struct pixel_traits<pixel::color_bits<5, 6, 5, 0>>
+{
+    using storage = std::uint16_t;
+    static constexpr Format format = Format::FORMAT_RGB16_565;
+    static constexpr storage pack(std::uint32_t argb32)
+    {
+        return static_cast<storage>(
+            (argb32 >> 8 & 0xf800) |
+            (argb32 >> 5 & 0x07e0) |
+            (argb32 >> 3 & 0x001f));
+    }
+    static constexpr std::uint32_t unpack(storage pixel)
+    {
+        const std::uint32_t r = pixel >> 11 & 0x1f;
+        const std::uint32_t g = pixel >> 5 & 0x3f;
+        const std::uint32_t b = pixel & 0x1f;
+        return
+            0xff000000u |
+            (r << 3 | r >> 2) << 16 |
+            (g << 2 | g >> 4) << 8 |
+            (b << 3 | b >> 2);
+    }
+};
+
+template<>
+struct pixel_traits<pixel::color_bits<0, 0, 0, 8>>
+{
+    using storage = std::uint8_t;
+    static constexpr Format format = Format::FORMAT_A8;
+    static constexpr storage pack(std::uint32_t argb32) { return static_cast<storage>(argb32 >> 24); }
+    static constexpr std::uint32_t unpack(storage pixel) { return std::uint32_t(pixel) << 24; }
+};
+
+
+namespace detail {
+
+    // premultiplied source over destination
+    constexpr std::uint32_t over(std::uint32_t source, std::uint32_t destination)
+    {
+        const std::uint32_t inverse = 255 - (source >> 24);
+        std::uint32_t result = 0;
+        for (int shift = 0; shift < 32; shift += 8)
+        {
+            const std::uint32_t d = (destination >> shift & 0xff) * inverse + 128;
+            result |= ((source >> shift & 0xff) + ((d + (d >> 8)) >> 8)) << shift;
+        }
+        return result;
+    }
+
+}
+
+
+// An image surface whose pixel layout is fixed at compile time, e.g.
+// typed_image_surface_t<pixel::color_bits<5, 6, 5, 0>> renders straight into a
+// 16 bit buffer. All surface_t drawing goes through cairo in that format; the
+// typed kernels work on the stored words without an ARGB32 copy.
+template<typename COLOR>
+class typed_image_surface_t: public image_surface_t
+{
+public:
+    using color = COLOR;
+    using traits = pixel_traits<COLOR>;
+    using storage = typename traits::storage;
+
+    typed_image_surface_t(int width, int height)
+        : image_surface_t(traits::format, width, height)
+    {}
+
+    using surface_t::fill;
+
+    storage* row(int y) { return reinterpret_cast<storage*>(data() + static_cast<std::ptrdiff_t>(y) * stride()); }
+    const storage* row(int y) const { return reinterpret_cast<const storage*>(data() + static_cast<std::ptrdiff_t>(y) * stride()); }
+
+    color pixel(int x, int y) const
+    {
+        flush();
+        return from_argb32(traits::unpack(row(y)[x]));
+    }
+
+    // replaces every pixel
+    void fill(const color& c)
+    {
+        const storage value = traits::pack(to_argb32(c));
+        flush();
+        const int w = width();
+        for (int y = 0, h = height(); y < h; ++y)
+        {
+            std::fill_n(row(y), w, value);
+        }
+        mark_dirty();
+    }
+
+    // composites c over the pixels of the rectangle, clipped to the surface
+    void blend(const color& c, int x, int y, int w, int h)
+    {
+        const std::uint32_t source = to_argb32(c);
+        const int x0 = std::max(x, 0);
+        const int y0 = std::max(y, 0);
+        const int x1 = std::min(x + w, width());
+        const int y1 = std::min(y + h, height());
+        flush();
+        for (int j = y0; j < y1; ++j)
+        {
+            storage* out = row(j);
+            for (int i = x0; i < x1; ++i)
+            {
+                out[i] = traits::pack(detail::over(source, traits::unpack(out[i])));
+            }
+        }
+        mark_dirty();
+    }
+
+    // copies into a surface of another layout, sizes are clipped to the smaller one
+    template<typename OTHER>
+    void convert_to(typed_image_surface_t<OTHER>& target) const
+    {
+        using target_traits = pixel_traits<OTHER>;
+        const int w = std::min(width(), target.width());
+        const int h = std::min(height(), target.height());
+        flush();
+        target.flush();
+        for (int y = 0; y < h; ++y)
+        {
+            const storage* in = row(y);
+            auto* out = target.row(y);
+            for (int x = 0; x < w; ++x)
+            {
+                out[x] = target_traits::pack(traits::unpack(in[x]));
+            }
+        }
+        target.mark_dirty();
+    }
+
+private:
+    static color from_argb32(std::uint32_t argb32)
+    {
+        const std::uint32_t alpha = argb32 >> 24;
+        auto channel = [&](int shift) -> std::uint32_t
+        {
+            const std::uint32_t value = argb32 >> shift & 0xff;
+            return alpha == 0 ? 0 : (value * 255 + alpha / 2) / alpha;
+        };
+        return color(
+            detail::from_8bit<typename color::red_channel>(channel(16)),
+            detail::from_8bit<typename color::green_channel>(channel(8)),
+            detail::from_8bit<typename color::blue_channel>(channel(0)),
+            detail::from_8bit<typename color::alpha_channel>(alpha));
+    }
+};
+
+
+}
@@ -0,0 +1,57 @@
+#include "graphics.h"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+
+// a grid, ticks, two function plots and a row of polygons, none of them
+// stored as a path
+void plots_scene(graphics2::surface_t& surface, double width, double height)
+{
+    using namespace graphics2;
+
+    surface.fill(color_t(1, 1, 1));
+    // 200 x 100 cells, 302 lines that are never stored anywhere
+    surface.stroke(pen_t(color_t(0, 0, 0, 0.1), 1), grid_t(pos_t(100, 50), width - 150, height - 150, 200, 100));
+    surface.stroke(pen_t(color_t(0, 0, 0), 1), ticks_t(pos_t(100, height - 100), pos_t(width - 50, height - 100), 40, -8));
+    surface.stroke(pen_t(color_t(0, 0, 0), 1), ticks_t(pos_t(100, height - 100), pos_t(100, 50), 20, 8));
+    surface.stroke(
+        pen_t(color_t(0.2, 0.4, 0.8), 2),
+        function_plot_t(
+            [](double x) { return std::sin(x) * std::exp(-x / 40); },
+            0, 200, -1.2, 1.2,
+            pos_t(100, 50), width - 150, height - 150));
+    // poles at odd multiples of pi/2, no sample hits one exactly but the plot
+    // is clipped to the range and breaks where the values jump across it
+    surface.stroke(
+        pen_t(color_t(0.8, 0.3, 0.2), 1),
+        function_plot_t(
+            [](double x) { return 0.1 * std::tan(x); },
+            0, 20, -1.2, 1.2,
+            pos_t(100, 50), width - 150, height - 150));
+    for (int sides = 3; sides <= 8; ++sides)
+    {
+        surface.fill(color_t(0.9, 0.6, 0.1, 0.5), regular_polygon_t(pos_t(150 + sides * 60, 120), 25, sides, -M_PI / 2));
+    }
+}
+
+
+void plots()
+{
+    using namespace graphics2;
+    using clock = std::chrono::steady_clock;
+    using ms = std::chrono::duration<double, std::milli>;
+
+    auto width = 1600.0;
+    auto height = 1000.0;
+    image_surface_t surface(Format::FORMAT_ARGB32, width, height);
+
+    auto start = clock::now();
+    plots_scene(surface, width, height);
+    surface.flush();
+    auto time = clock::now() - start;
+
+    std::string filename = "plots.png";
+    surface.write_to_png(filename);
+    std::cout << "generated paths: " << ms(time).count() << " ms, wrote \"" << filename << "\"" << std::endl;
+}
@@ -0,0 +1,58 @@
+#include "graphics.h"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+
+// thin circles, translucent discs and small labels, where the quality
+// profiles differ most
+void circles_scene(graphics2::surface_t& surface, double width, double height)
+{
+    using namespace graphics2;
+
+    auto font = font_t(
+        toy_font_face_t("Bitstream Charter", FontSlant::FONT_SLANT_NORMAL, FontWeight::FONT_WEIGHT_NORMAL),
+        color_t(0.2, 0.2, 0.2),
+        10);
+    surface.fill(color_t(1, 1, 1));
+    auto pen = pen_t(color_t(0, 0, 0, 0.7), 1.5);
+    for (int i = 0; i < 2000; ++i)
+    {
+        const pos_t center(width * ((i * 37) % 101) / 101.0, height * ((i * 53) % 97) / 97.0);
+        surface.stroke(pen, arc_t(center, 3 + i % 20, 0, 2*M_PI));
+        surface.fill(color_t(0.2, 0.4, 0.8, 0.3), arc_t(center, 2 + i % 7, 0, 2*M_PI));
+        if (i % 10 == 0)
+            surface.print(font, center, "label");
+    }
+}
+
+
+void quality()
+{
+    using namespace graphics2;
+    using clock = std::chrono::steady_clock;
+    using ms = std::chrono::duration<double, std::milli>;
+
+    auto width = 600;
+    auto height = 400;
+
+    const std::pair<const char*, quality_t> profiles[] = {
+        {"fast", quality_t::fast},
+        {"good", quality_t::good},
+        {"best", quality_t::best},
+    };
+    for (const auto& profile: profiles)
+    {
+        image_surface_t surface(Format::FORMAT_ARGB32, width, height);
+        surface.quality(profile.second);
+
+        auto start = clock::now();
+        circles_scene(surface, width, height);
+        surface.flush();
+        auto time = clock::now() - start;
+
+        std::string filename = std::string("quality-") + profile.first + ".png";
+        surface.write_to_png(filename);
+        std::cout << profile.first << ": " << ms(time).count() << " ms, wrote \"" << filename << "\"" << std::endl;
+    }
+}
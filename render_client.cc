@@ -0,0 +1,153 @@
+#include "graphics.h"
+#include "render_protocol.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+
+// Load generator for render-server: every connection sends the same chart
+// scene back to back and times each round trip.
+//
+//     render-client [socket] [connections] [requests] [width] [height]
+
+
+using namespace graphics2;
+
+
+// in chart.cc
+command_buffer_t chart_scene(double width, double height);
+
+
+namespace {
+
+
+    // round trip times in nanoseconds
+    std::vector<double> run_connection(
+        const std::string& path, const std::string& scene, int requests, int width, int height, bool save)
+    {
+        render::request_t request;
+        request.width = std::uint32_t(width);
+        request.height = std::uint32_t(height);
+        request.stride = std::uint32_t(image_surface_t::stride_for_width(Format::FORMAT_ARGB32, width));
+        request.scene_size = scene.size();
+        request.pixel_offset = render::pixel_offset(scene.size());
+        request.segment_size = request.pixel_offset + std::uint64_t(request.stride) * request.height;
+        render::shared_memory_t segment(request.segment_size);
+
+        const int socket = render::connect_socket(path);
+        std::vector<double> times;
+        times.reserve(std::size_t(requests));
+        for (int i = 0; i < requests; ++i)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            // a real client writes a new scene every time
+            std::memcpy(segment.data(), scene.data(), scene.size());
+            render::send_request(socket, request, segment.fd());
+            render::response_t response;
+            if (!render::receive_response(socket, response))
+                throw std::runtime_error("server closed the connection");
+            if (response.status != 0)
+                throw std::system_error(response.status, std::generic_category(), "render request");
+            times.push_back(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count());
+        }
+        ::close(socket);
+
+        if (save)
+        {
+            image_surface_t image(
+                segment.data() + request.pixel_offset, Format::FORMAT_ARGB32, width, height, int(request.stride));
+            image.write_to_png("render-client.png");
+        }
+        return times;
+    }
+
+
+    double percentile(const std::vector<double>& sorted, double p)
+    {
+        const auto index = std::size_t(std::ceil(p / 100 * sorted.size()));
+        return sorted[std::min(sorted.size() - 1, index > 0 ? index - 1 : 0)];
+    }
+
+
+}
+
+
+int main(int argc, char* argv[])
+{
+    const std::string path = argc > 1 ? argv[1] : "/tmp/graphics2-render.sock";
+    const int connections = argc > 2 ? std::max(1, std::stoi(argv[2])) : 4;
+    const int requests = argc > 3 ? std::max(1, std::stoi(argv[3])) : 1000;
+    const int width = argc > 4 ? std::stoi(argv[4]) : 800;
+    const int height = argc > 5 ? std::stoi(argv[5]) : 600;
+
+    const auto scene = chart_scene(width, height).serialize();
+    const auto count = std::size_t(connections);
+    std::vector<std::vector<double>> times(count);
+    std::vector<std::exception_ptr> errors(count);
+    std::vector<std::thread> threads;
+
+    const auto start = std::chrono::steady_clock::now();
+    for (int c = 0; c < connections; ++c)
+    {
+        threads.emplace_back([&, c]()
+        {
+            try
+            {
+                times[c] = run_connection(path, scene, requests, width, height, c == 0);
+            }
+            catch (...)
+            {
+                errors[c] = std::current_exception();
+            }
+        });
+    }
+    for (auto& thread: threads)
+    {
+        thread.join();
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    for (const auto& error: errors)
+    {
+        try
+        {
+            if (error)
+                std::rethrow_exception(error);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<double> all;
+    for (const auto& connection: times)
+    {
+        all.insert(all.end(), connection.begin(), connection.end());
+    }
+    std::sort(all.begin(), all.end());
+    std::cout << std::fixed << std::setprecision(1)
+        << all.size() << " requests of " << scene.size() << " byte scenes over "
+        << connections << " connections, " << width << "x" << height << " pixels" << std::endl
+        << all.size() / elapsed.count() << " requests/s" << std::endl
+        << std::setprecision(3)
+        << "latency ms: p50 " << percentile(all, 50) / 1e6
+        << ", p90 " << percentile(all, 90) / 1e6
+        << ", p99 " << percentile(all, 99) / 1e6
+        << ", p99.9 " << percentile(all, 99.9) / 1e6
+        << ", max " << all.back() / 1e6 << std::endl;
+    return 0;
+}
@@ -0,0 +1,308 @@
+#include "render_protocol.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+
+namespace graphics2 {
+
+
+namespace render {
+
+
+namespace {
+
+
+    std::system_error system_error(const char* what, int error = errno)
+    {
+        return std::system_error(error, std::generic_category(), what);
+    }
+
+
+    sockaddr_un socket_address(const std::string& path)
+    {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path))
+            throw system_error("socket path", ENAMETOOLONG);
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        return address;
+    }
+
+
+    // SOCK_SEQPACKET keeps message boundaries, a message arrives whole or not at all
+    void send_message(int socket, const void* data, std::size_t size, int fd)
+    {
+        iovec io{const_cast<void*>(data), size};
+        msghdr message{};
+        message.msg_iov = &io;
+        message.msg_iovlen = 1;
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+        if (fd >= 0)
+        {
+            message.msg_control = control;
+            message.msg_controllen = sizeof(control);
+            cmsghdr* header = CMSG_FIRSTHDR(&message);
+            header->cmsg_level = SOL_SOCKET;
+            header->cmsg_type = SCM_RIGHTS;
+            header->cmsg_len = CMSG_LEN(sizeof(int));
+            std::memcpy(CMSG_DATA(header), &fd, sizeof(int));
+        }
+        ssize_t sent;
+        do
+        {
+            sent = ::sendmsg(socket, &message, MSG_NOSIGNAL);
+        } while (sent < 0 && errno == EINTR);
+        if (sent < 0)
+            throw system_error("sendmsg");
+    }
+
+
+    bool receive_message(int socket, void* data, std::size_t size, int* fd)
+    {
+        iovec io{data, size};
+        msghdr message{};
+        message.msg_iov = &io;
+        message.msg_iovlen = 1;
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        ssize_t received;
+        do
+        {
+            received = ::recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+        } while (received < 0 && errno == EINTR);
+        if (received < 0)
+            throw system_error("recvmsg");
+
+        int passed = -1;
+        for (cmsghdr* header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header))
+        {
+            if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS)
+                std::memcpy(&passed, CMSG_DATA(header), sizeof(int));
+        }
+        if (fd)
+            *fd = passed;
+        else if (passed >= 0)
+            ::close(passed);
+
+        if (received == 0)
+        {
+            if (fd && *fd >= 0)
+                ::close(*fd);
+            return false;
+        }
+        if (static_cast<std::size_t>(received) != size || message.msg_flags & (MSG_TRUNC | MSG_CTRUNC))
+        {
+            if (fd && *fd >= 0)
+                ::close(*fd);
+            throw system_error("malformed message", EPROTO);
+        }
+        return true;
+    }
+
+
+    // true when path is a socket nothing listens on any more; anything else
+    // at the path, a live server in particular, is left alone
+    bool is_stale_socket(const std::string& path)
+    {
+        struct stat status;
+        if (::lstat(path.c_str(), &status) < 0 || !S_ISSOCK(status.st_mode))
+            return false;
+        const auto address = socket_address(path);
+        const int fd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+            return false;
+        const bool refused = ::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0 &&
+            errno == ECONNREFUSED;
+        ::close(fd);
+        return refused;
+    }
+
+
+}
+
+
+std::size_t pixel_offset(std::size_t scene_size)
+{
+    return (scene_size + 63) & ~std::size_t(63);
+}
+
+
+shared_memory_t::shared_memory_t(std::size_t size)
+    : _size(size)
+{
+    _fd = ::memfd_create("graphics2", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (_fd < 0)
+        throw system_error("memfd_create");
+    // the server maps the segment too, it must never shrink under its mapping
+    if (::ftruncate(_fd, static_cast<off_t>(size)) < 0 ||
+        ::fcntl(_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0)
+    {
+        const int error = errno;
+        release();
+        throw system_error("memfd seals", error);
+    }
+    void* data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (data == MAP_FAILED)
+    {
+        const int error = errno;
+        release();
+        throw system_error("mmap", error);
+    }
+    _data = static_cast<unsigned char*>(data);
+}
+
+
+shared_memory_t::shared_memory_t(int fd, std::size_t size)
+    : _fd(fd)
+    , _size(size)
+{
+    // a segment the sender could still truncate would fault on access
+    // (SIGBUS) once it is mapped, only a sealed one is safe
+    const int seals = ::fcntl(_fd, F_GET_SEALS);
+    if (seals < 0 || !(seals & F_SEAL_SHRINK))
+    {
+        release();
+        throw system_error("shared memory segment not sealed against shrinking", EPERM);
+    }
+    struct stat status;
+    if (::fstat(_fd, &status) < 0)
+    {
+        const int error = errno;
+        release();
+        throw system_error("fstat", error);
+    }
+    if (status.st_size < 0 || static_cast<std::size_t>(status.st_size) < size)
+    {
+        release();
+        throw system_error("shared memory segment too small", EINVAL);
+    }
+    void* data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (data == MAP_FAILED)
+    {
+        const int error = errno;
+        release();
+        throw system_error("mmap", error);
+    }
+    _data = static_cast<unsigned char*>(data);
+}
+
+
+shared_memory_t::shared_memory_t(shared_memory_t&& other)
+    : _fd(other._fd)
+    , _size(other._size)
+    , _data(other._data)
+{
+    other._fd = -1;
+    other._data = nullptr;
+}
+
+
+shared_memory_t& shared_memory_t::operator=(shared_memory_t&& other)
+{
+    if (this != &other)
+    {
+        release();
+        _fd = other._fd;
+        _size = other._size;
+        _data = other._data;
+        other._fd = -1;
+        other._data = nullptr;
+    }
+    return *this;
+}
+
+
+shared_memory_t::~shared_memory_t()
+{
+    release();
+}
+
+
+void shared_memory_t::release()
+{
+    if (_data)
+        ::munmap(_data, _size);
+    if (_fd >= 0)
+        ::close(_fd);
+    _data = nullptr;
+    _fd = -1;
+}
+
+
+int listen_socket(const std::string& path)
+{
+    const auto address = socket_address(path);
+    const int fd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        throw system_error("socket");
+    bool bound = ::bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+    if (!bound && errno == EADDRINUSE && is_stale_socket(path))
+    {
+        // a socket file left behind by a server that is gone
+        ::unlink(path.c_str());
+        bound = ::bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+    }
+    if (!bound || ::listen(fd, SOMAXCONN) < 0)
+    {
+        const int error = errno;
+        ::close(fd);
+        throw system_error("bind", error);
+    }
+    return fd;
+}
+
+
+int connect_socket(const std::string& path)
+{
+    const auto address = socket_address(path);
+    const int fd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        throw system_error("socket");
+    if (::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0)
+    {
+        const int error = errno;
+        ::close(fd);
+        throw system_error("connect", error);
+    }
+    return fd;
+}
+
+
+void send_request(int socket, const request_t& request, int fd)
+{
+    send_message(socket, &request, sizeof(request), fd);
+}
+
+
+bool receive_request(int socket, request_t& request, int& fd)
+{
+    return receive_message(socket, &request, sizeof(request), &fd);
+}
+
+
+void send_response(int socket, const response_t& response)
+{
+    send_message(socket, &response, sizeof(response), -1);
+}
+
+
+bool receive_response(int socket, response_t& response)
+{
+    return receive_message(socket, &response, sizeof(response), nullptr);
+}
+
+
+}
+
+
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+// The render server protocol. A client serializes a command_buffer_t to the
+// start of a shared memory segment and sends a request_t over a Unix domain
+// socket, passing the segment's file descriptor along with it. The server
+// renders straight into the same segment at pixel_offset and answers with a
+// response_t, so only the two small messages go through the socket.
+
+
+namespace graphics2 {
+
+
+namespace render {
+
+
+    constexpr std::uint32_t protocol_magic = 0x52433247; // "G2CR"
+
+
+    struct request_t
+    {
+        std::uint32_t magic = protocol_magic;
+        // ARGB32 pixels at pixel_offset, rows stride bytes apart
+        std::uint32_t width = 0;
+        std::uint32_t height = 0;
+        std::uint32_t stride = 0;
+        std::uint64_t scene_size = 0;
+        std::uint64_t pixel_offset = 0;
+        std::uint64_t segment_size = 0;
+    };
+
+
+    struct response_t
+    {
+        // 0 on success, otherwise an errno value
+        std::int32_t status = 0;
+        std::uint64_t render_ns = 0;
+    };
+
+
+    // where the pixels start after a scene of the given size, cache line aligned
+    std::size_t pixel_offset(std::size_t scene_size);
+
+
+    // An anonymous shared memory segment (memfd) mapped read/write, created
+    // with a size or adopted from a descriptor received over the socket.
+    // Created segments are sealed against resizing, so a peer that maps one
+    // cannot be made to fault by truncating it.
+    class shared_memory_t
+    {
+    public:
+        explicit shared_memory_t(std::size_t size);
+        // takes ownership of fd, throws when the segment is smaller than size
+        // or not sealed against shrinking
+        shared_memory_t(int fd, std::size_t size);
+        shared_memory_t(shared_memory_t&&);
+        shared_memory_t& operator=(shared_memory_t&&);
+        ~shared_memory_t();
+
+        int fd() const { return _fd; }
+        std::size_t size() const { return _size; }
+        unsigned char* data() { return _data; }
+        const unsigned char* data() const { return _data; }
+
+    private:
+        void release();
+
+        int _fd = -1;
+        std::size_t _size = 0;
+        unsigned char* _data = nullptr;
+    };
+
+
+    // socket helpers, all throw std::system_error
+    int listen_socket(const std::string& path);
+    int connect_socket(const std::string& path);
+    void send_request(int socket, const request_t&, int fd);
+    // false when the peer closed the connection, fd is -1 if none came along
+    bool receive_request(int socket, request_t&, int& fd);
+    void send_response(int socket, const response_t&);
+    bool receive_response(int socket, response_t&);
+
+
+}
+
+
+}
@@ -0,0 +1,245 @@
+#include "graphics.h"
+#include "render_protocol.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+
+// Renders scenes for the clients on this machine on a pool of worker
+// threads, one per core unless given. A connection stays with the worker that
+// accepted it, which serves its connections round robin, one request at a
+// time, so their clients find the same warm caches: glyphs rasterized for one
+// are in the worker's atlas for all, and toy font faces stay alive in it.
+
+
+using namespace graphics2;
+
+
+namespace {
+
+
+    const int max_size = 16384;
+
+
+    // Clients normally send the same segment with every request, it stays
+    // mapped with the surface on it for as long as they do.
+    struct client_t
+    {
+        explicit client_t(int socket)
+            : socket(socket)
+        {}
+
+        int socket;
+        dev_t device = 0;
+        ino_t inode = 0;
+        std::unique_ptr<render::shared_memory_t> segment;
+        std::unique_ptr<image_surface_t> surface;
+        render::request_t layout;
+    };
+
+
+    bool is_valid(const render::request_t& request)
+    {
+        if (request.magic != render::protocol_magic)
+            return false;
+        if (request.width == 0 || request.height == 0 || request.width > max_size || request.height > max_size)
+            return false;
+        const auto stride = image_surface_t::stride_for_width(Format::FORMAT_ARGB32, int(request.width));
+        if (request.stride < std::uint32_t(stride) || request.stride % 4 != 0 || request.pixel_offset % 4 != 0)
+            return false;
+        if (request.scene_size > request.pixel_offset || request.pixel_offset > request.segment_size)
+            return false;
+        return std::uint64_t(request.stride) * request.height <= request.segment_size - request.pixel_offset;
+    }
+
+
+    // takes ownership of fd; shared_memory_t refuses segments that are not
+    // sealed against shrinking, and a segment already mapped was checked when
+    // it was first mapped since seals cannot be removed
+    void map_segment(client_t& client, const render::request_t& request, int fd)
+    {
+        struct stat status;
+        if (::fstat(fd, &status) < 0)
+        {
+            const int error = errno;
+            ::close(fd);
+            throw std::system_error(error, std::generic_category(), "fstat");
+        }
+        if (client.segment && client.device == status.st_dev && client.inode == status.st_ino &&
+            client.segment->size() == request.segment_size)
+        {
+            ::close(fd);
+            return;
+        }
+        client.surface.reset();
+        client.segment.reset();
+        client.segment.reset(new render::shared_memory_t(fd, request.segment_size));
+        client.device = status.st_dev;
+        client.inode = status.st_ino;
+    }
+
+
+    image_surface_t& surface_for(client_t& client, const render::request_t& request, const std::shared_ptr<glyph_atlas_t>& atlas)
+    {
+        const auto& layout = client.layout;
+        if (!client.surface || layout.width != request.width || layout.height != request.height ||
+            layout.stride != request.stride || layout.pixel_offset != request.pixel_offset)
+        {
+            client.surface.reset(new image_surface_t(
+                client.segment->data() + request.pixel_offset, Format::FORMAT_ARGB32,
+                int(request.width), int(request.height), int(request.stride)));
+            client.surface->glyph_atlas(atlas);
+            client.layout = request;
+        }
+        return *client.surface;
+    }
+
+
+    render::response_t render_request(
+        client_t& client,
+        const render::request_t& request,
+        int fd,
+        const std::shared_ptr<glyph_atlas_t>& atlas)
+    {
+        render::response_t response;
+        if (fd < 0 || !is_valid(request))
+        {
+            if (fd >= 0)
+                ::close(fd);
+            response.status = EINVAL;
+            return response;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        try
+        {
+            map_segment(client, request, fd);
+            // read straight from the segment, only the request went through the socket
+            const auto scene = command_buffer_t::deserialize(client.segment->data(), request.scene_size);
+            auto& surface = surface_for(client, request, atlas);
+            surface.flush();
+            std::memset(surface.data(), 0, std::size_t(request.stride) * request.height);
+            surface.mark_dirty();
+            scene.replay(surface);
+            surface.flush();
+        }
+        catch (const std::system_error& e)
+        {
+            response.status = e.code().value();
+        }
+        catch (const std::runtime_error&)
+        {
+            response.status = EPROTO;
+        }
+        catch (const std::exception&)
+        {
+            response.status = EIO;
+        }
+        response.render_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        return response;
+    }
+
+
+    // false when the connection is done
+    bool serve(client_t& client, const std::shared_ptr<glyph_atlas_t>& atlas)
+    {
+        try
+        {
+            render::request_t request;
+            int fd = -1;
+            if (!render::receive_request(client.socket, request, fd))
+                return false;
+            render::send_response(client.socket, render_request(client, request, fd, atlas));
+            return true;
+        }
+        catch (const std::system_error& e)
+        {
+            std::cerr << "client " << client.socket << ": " << e.what() << std::endl;
+            return false;
+        }
+    }
+
+
+    // serves the connections it accepted until poll fails
+    void work(int listener)
+    {
+        auto atlas = std::make_shared<glyph_atlas_t>();
+        std::vector<client_t> clients;
+        std::vector<pollfd> polled;
+        for (;;)
+        {
+            polled.assign(1, pollfd{listener, POLLIN, 0});
+            for (const auto& client: clients)
+            {
+                polled.push_back(pollfd{client.socket, POLLIN, 0});
+            }
+            if (::poll(polled.data(), polled.size(), -1) < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                std::cerr << "poll: " << std::strerror(errno) << std::endl;
+                return;
+            }
+
+            // every ready client gets one request per round
+            for (std::size_t i = clients.size(); i-- > 0;)
+            {
+                if (polled[i + 1].revents == 0)
+                    continue;
+                if (!serve(clients[i], atlas))
+                {
+                    ::close(clients[i].socket);
+                    clients.erase(clients.begin() + std::ptrdiff_t(i));
+                }
+            }
+
+            if (polled[0].revents & POLLIN)
+            {
+                const int socket = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+                if (socket >= 0)
+                    clients.emplace_back(socket);
+            }
+        }
+    }
+
+
+}
+
+
+int main(int argc, char* argv[])
+{
+    const std::string path = argc > 1 ? argv[1] : "/tmp/graphics2-render.sock";
+    const unsigned workers = argc > 2 ? unsigned(std::max(1, std::atoi(argv[2]))) : std::max(1u, std::thread::hardware_concurrency());
+    const int listener = render::listen_socket(path);
+    // the workers race for new connections, the losers see EAGAIN
+    ::fcntl(listener, F_SETFL, ::fcntl(listener, F_GETFL) | O_NONBLOCK);
+    std::cout << "Listening on \"" << path << "\" with " << workers << " workers" << std::endl;
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < workers; ++i)
+    {
+        threads.emplace_back(work, listener);
+    }
+    for (auto& thread: threads)
+    {
+        thread.join();
+    }
+    return 1;
+}
@@ -0,0 +1,40 @@
+#include "graphics.h"
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+
+void report()
+{
+    using namespace graphics2;
+
+    auto width = 595.0;
+    auto height = 842.0;
+    std::string filename = "report.pdf";
+    std::ofstream out(filename, std::ios::binary);
+
+    // drawn on every page but embedded in the document only once
+    image_surface_t logo(Format::FORMAT_ARGB32, 64, 64);
+    logo.fill(color_t(0.86, 0.85, 0.47));
+    logo.stroke(pen_t(4), arc_t(pos_t(32, 32), 24, 0, 2*M_PI));
+
+    auto font = font_t(
+        toy_font_face_t("Bitstream Charter", FontSlant::FONT_SLANT_NORMAL, FontWeight::FONT_WEIGHT_NORMAL),
+        color_t(0.2, 0.2, 0.2),
+        24);
+
+    {
+        pdf_surface_t surface(out, width, height);
+        for (int page = 1; page <= 200; ++page)
+        {
+            surface.draw_image(logo, pos_t(width - 96, 32), 64, 64);
+            surface.print(font, pos_t(48, 80), "Page " + std::to_string(page));
+            surface.stroke(
+                pen_t(color_t(0, 0, 0, 0.7), 2),
+                line_t(pos_t(48, 120), pos_t(width - 48, 120)));
+            surface.show_page();
+        }
+    }
+
+    std::cout << "Wrote PDF file \"" << filename << "\"" << std::endl;
+}
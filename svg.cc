@@ -1,6 +1,12 @@
 #include "graphics.h"
+#include <chrono>
 #include <cmath>
 #include <iostream>
+#include <sstream>
+#include <utility>
+
+
+void shapes_scene(graphics2::surface_t& surface, double width, double height);
 
 
 void svg()
@@ -10,27 +16,59 @@ void svg()
     auto width = 600;
     auto height = 400;
     svg_surface_t surface(filename, width, height);
-
-    surface.fill(color_t(0.86, 0.85, 0.47));
-    auto rectangle = rectangle_t(pos_t(0, 0), pos_t(width, height));
-    auto rect_pen = pen_t(20);
-    surface.stroke(rect_pen, rectangle);
-
-    auto black = color_t(0, 0, 0, 0.7);
-    auto circle = arc_t(
-        pos_t(width / 2.0, height / 2.0),
-        height / 4.0,
-        0.0,
-        2.0 * M_PI);
-    auto circ_pen = pen_t(black, 20);
-    surface.stroke(circ_pen, circle);
-
-    auto line = line_t(
-        pos_t(width / 4.0, height / 4.0),
-        pos_t(width * 3.0 / 4.0, height * 3.0 / 4.0));
-    surface.stroke(circ_pen, line);
-
+    shapes_scene(surface, width, height);
     surface.show_page();
 
     std::cout << "Wrote SVG file \"" << filename << "\"" << std::endl;
 }
+
+
+// many small primitives, mostly repeated markers as in a scatter plot
+void scatter_scene(graphics2::surface_t& surface, double width, double height, int markers)
+{
+    using namespace graphics2;
+    surface.fill(color_t(1, 1, 1));
+    auto pen = pen_t(color_t(0.2, 0.2, 0.6), 0.5);
+    for (int i = 0; i < markers; ++i)
+    {
+        const double x = width * ((i * 7919) % 10007) / 10007.0;
+        const double y = height * ((i * 104729) % 10009) / 10009.0;
+        path_t marker;
+        marker += line_t(pos_t(x - 2, y - 2), pos_t(x + 2, y + 2));
+        marker += line_t(pos_t(x - 2, y + 2), pos_t(x + 2, y - 2));
+        surface.stroke(pen, marker);
+    }
+}
+
+
+void svg_benchmark()
+{
+    using namespace graphics2;
+    using clock = std::chrono::steady_clock;
+    using ms = std::chrono::duration<double, std::milli>;
+    auto width = 600;
+    auto height = 400;
+
+    svg_options_t quantized;
+    quantized.precision = 1;
+    svg_options_t deduplicated = quantized;
+    deduplicated.deduplicate = true;
+
+    const std::pair<const char*, svg_options_t> variants[] = {
+        {"full precision", svg_options_t()},
+        {"quantized", quantized},
+        {"quantized, deduplicated", deduplicated},
+    };
+    for (const auto& variant: variants)
+    {
+        std::ostringstream out;
+        auto start = clock::now();
+        {
+            svg_surface_t surface(out, width, height, variant.second);
+            scatter_scene(surface, width, height, 100000);
+        }
+        auto time = clock::now() - start;
+        std::cout << variant.first << ": " << out.str().size() << " bytes in "
+                  << ms(time).count() << " ms" << std::endl;
+    }
+}
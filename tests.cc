@@ -0,0 +1,313 @@
+#include "graphics.h"
+#include "pixels.h"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+// Regression tests: the self-checking demos, and the demo scenes rendered in
+// process and compared with the goldens in tests/golden. An image fails when
+// more pixels than its scene's budget differ by more than a perceptual delta
+// of 0.1, which leaves room for antialiasing and hinting differences; svg
+// documents are compared byte for byte. A missing golden fails too. The
+// actual image and a diff heatmap are written to the working directory then.
+// --update writes the goldens instead, check them before committing.
+//
+//     graphics2-tests [--checks | --goldens] [--update] [golden directory]
+
+
+using namespace graphics2;
+
+
+// self-checking demos, each returns its number of failures
+int arena();
+int compositing();
+int layers();
+int parallel();
+int typed_surfaces();
+
+// the demos' scenes
+command_buffer_t chart_scene(double width, double height);
+void circles_scene(surface_t& surface, double width, double height);
+void heatmap_scene(image_surface_t& surface);
+void plots_scene(surface_t& surface, double width, double height);
+void scatter_scene(surface_t& surface, double width, double height, int markers);
+void shapes_scene(surface_t& surface, double width, double height);
+void text_scene(surface_t& surface);
+void user_font_scene(surface_t& surface, const font_t& font);
+
+
+namespace {
+
+
+    struct golden_t
+    {
+        std::string directory;
+        bool update = false;
+    };
+
+
+    // a delta of 0.1 is about what separates two antialiasing levels of an
+    // edge pixel, budget is the number of pixels allowed above it
+    const double threshold = 0.1;
+
+
+    int check_image(const golden_t& golden, const std::string& name, image_surface_t& actual, std::size_t budget)
+    {
+        const auto filename = name + ".png";
+        const auto path = golden.directory + "/" + filename;
+        actual.flush();
+        if (golden.update)
+        {
+            actual.write_to_png(path);
+            std::cout << name << ": wrote \"" << path << "\"" << std::endl;
+            return 0;
+        }
+        if (!std::ifstream(path))
+        {
+            actual.write_to_png(filename);
+            std::cout << name << ": FAILED, no golden \"" << path << "\"" << std::endl;
+            return 1;
+        }
+
+        auto expected = image_surface_t::from_png(path);
+        image_surface_t heatmap(Format::FORMAT_ARGB32, expected.width(), expected.height());
+        const auto difference = compare_images(expected, actual, threshold, &heatmap);
+        if (difference.size_mismatch)
+        {
+            actual.write_to_png(filename);
+            std::cout << name << ": FAILED, size differs" << std::endl;
+            return 1;
+        }
+        if (difference.differing_pixels > budget)
+        {
+            actual.write_to_png(filename);
+            heatmap.write_to_png("diff-" + filename);
+            std::cout << name << ": FAILED, " << difference.differing_pixels << " pixels differ, " << budget
+                      << " allowed, max delta " << difference.max_delta << std::endl;
+            return 1;
+        }
+        std::cout << name << ": ok" << std::endl;
+        return 0;
+    }
+
+
+    // svg output is compared byte for byte
+    int check_text(const golden_t& golden, const std::string& name, const std::string& actual)
+    {
+        const auto path = golden.directory + "/" + name;
+        if (golden.update)
+        {
+            std::ofstream(path, std::ios::binary) << actual;
+            std::cout << name << ": wrote \"" << path << "\"" << std::endl;
+            return 0;
+        }
+        std::ifstream in(path, std::ios::binary);
+        if (!in)
+        {
+            std::ofstream(name, std::ios::binary) << actual;
+            std::cout << name << ": FAILED, no golden \"" << path << "\"" << std::endl;
+            return 1;
+        }
+        std::ostringstream expected;
+        expected << in.rdbuf();
+        if (expected.str() != actual)
+        {
+            std::ofstream(name, std::ios::binary) << actual;
+            std::cout << name << ": FAILED, differs from the golden" << std::endl;
+            return 1;
+        }
+        std::cout << name << ": ok" << std::endl;
+        return 0;
+    }
+
+
+    // a 4 x 3 raster magnified twenty times: nearest shows every source pixel
+    // unchanged at the centre of its block, bilinear blends across the edges
+    int check_draw_pixels()
+    {
+        using entry = pixel::color_bits<8, 8, 8, 8>;
+        std::vector<entry> pixels;
+        for (int i = 0; i < 12; ++i)
+        {
+            pixels.emplace_back(std::uint8_t(i * 20), std::uint8_t(255 - i * 20), std::uint8_t(i % 2 * 255), std::uint8_t(i < 6 ? 255 : 128));
+        }
+        image_surface_t nearest(Format::FORMAT_ARGB32, 80, 60);
+        image_surface_t bilinear(Format::FORMAT_ARGB32, 80, 60);
+        draw_pixels(nearest, pixels.data(), 4, 3, pos_t(0, 0), 80, 60, Filter::FILTER_NEAREST);
+        draw_pixels(bilinear, pixels.data(), 4, 3, pos_t(0, 0), 80, 60, Filter::FILTER_BILINEAR);
+        nearest.flush();
+        bilinear.flush();
+
+        int failures = 0;
+        int blended = 0;
+        for (int y = 0; y < 3; ++y)
+        {
+            for (int x = 0; x < 4; ++x)
+            {
+                const auto* row = reinterpret_cast<const std::uint32_t*>(nearest.data() + (y * 20 + 10) * nearest.stride());
+                if (row[x * 20 + 10] != to_argb32(pixels[std::size_t(y) * 4 + x]))
+                    ++failures;
+            }
+        }
+        for (int x = 1; x < 80; ++x)
+        {
+            const auto* row = reinterpret_cast<const std::uint32_t*>(bilinear.data() + 10 * bilinear.stride());
+            if (row[x] != row[x - 1])
+                ++blended;
+        }
+        if (failures > 0 || blended <= 3)
+        {
+            std::cout << "draw_pixels: FAILED, " << failures << " nearest blocks wrong, "
+                      << blended << " bilinear steps in a row" << std::endl;
+            return 1;
+        }
+        std::cout << "draw_pixels: ok" << std::endl;
+        return 0;
+    }
+
+
+    // the demo scenes, each with the pixels it may differ by; text and thin
+    // strokes differ the most between cairo and font versions
+    int run_goldens(const golden_t& golden)
+    {
+        int failures = 0;
+        {
+            image_surface_t surface(Format::FORMAT_ARGB32, 600, 400);
+            shapes_scene(surface, 600, 400);
+            failures += check_image(golden, "shapes", surface, 20);
+        }
+        {
+            image_surface_t surface(Format::FORMAT_ARGB32, 600, 400);
+            heatmap_scene(surface);
+            failures += check_image(golden, "heatmap", surface, 20);
+        }
+        {
+            image_surface_t surface(Format::FORMAT_ARGB32, 400, 200);
+            text_scene(surface);
+            failures += check_image(golden, "text", surface, 200);
+        }
+        {
+            image_surface_t surface(Format::FORMAT_ARGB32, 400, 200);
+            surface.glyph_atlas(std::make_shared<glyph_atlas_t>());
+            text_scene(surface);
+            failures += check_image(golden, "text-atlas", surface, 200);
+        }
+        {
+            // user fonts are not implemented, a toy font stands in for main's box font
+            image_surface_t surface(Format::FORMAT_ARGB32, 400, 200);
+            user_font_scene(
+                surface,
+                font_t(
+                    toy_font_face_t("sans-serif", FontSlant::FONT_SLANT_NORMAL, FontWeight::FONT_WEIGHT_NORMAL),
+                    color_t(0.8, 0.2, 0.2),
+                    64));
+            failures += check_image(golden, "user-font", surface, 200);
+        }
+        {
+            image_surface_t surface(Format::FORMAT_ARGB32, 800, 500);
+            plots_scene(surface, 800, 500);
+            failures += check_image(golden, "plots", surface, 200);
+        }
+        const std::pair<const char*, quality_t> profiles[] = {
+            {"circles-fast", quality_t::fast},
+            {"circles-good", quality_t::good},
+            {"circles-best", quality_t::best},
+        };
+        for (const auto& profile: profiles)
+        {
+            image_surface_t surface(Format::FORMAT_ARGB32, 600, 400);
+            surface.quality(profile.second);
+            circles_scene(surface, 600, 400);
+            failures += check_image(golden, profile.first, surface, 500);
+        }
+        {
+            image_surface_t surface(Format::FORMAT_ARGB32, 1000, 700);
+            scatter_scene(surface, 1000, 700, 100000);
+            failures += check_image(golden, "scatter", surface, 500);
+        }
+        {
+            // through serialize(), as the render server gets it
+            const auto bytes = chart_scene(400, 300).serialize();
+            image_surface_t surface(Format::FORMAT_ARGB32, 400, 300);
+            command_buffer_t::deserialize(bytes.data(), bytes.size()).replay(surface);
+            failures += check_image(golden, "chart", surface, 200);
+        }
+        {
+            std::ostringstream out;
+            {
+                svg_surface_t surface(out, 600, 400);
+                shapes_scene(surface, 600, 400);
+            }
+            failures += check_text(golden, "shapes.svg", out.str());
+        }
+        {
+            svg_options_t options;
+            options.precision = 1;
+            options.deduplicate = true;
+            std::ostringstream out;
+            {
+                svg_surface_t surface(out, 600, 400, options);
+                scatter_scene(surface, 600, 400, 2000);
+                plots_scene(surface, 600, 400);
+            }
+            failures += check_text(golden, "scatter.svg", out.str());
+        }
+        return failures;
+    }
+
+
+    // checks that need no goldens
+    int run_checks()
+    {
+        int failures = 0;
+        failures += check_draw_pixels();
+        failures += arena();
+        failures += compositing();
+        failures += layers();
+        failures += parallel();
+        failures += typed_surfaces();
+        return failures;
+    }
+
+
+}
+
+
+int main(int argc, char* argv[])
+{
+    golden_t golden;
+    golden.directory = GRAPHICS2_GOLDEN_DIRECTORY;
+    bool checks = true;
+    bool goldens = true;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--update") == 0)
+            golden.update = true;
+        else if (std::strcmp(argv[i], "--checks") == 0)
+            goldens = false;
+        else if (std::strcmp(argv[i], "--goldens") == 0)
+            checks = false;
+        else
+            golden.directory = argv[i];
+    }
+
+    int failures = 0;
+    if (goldens)
+        failures += run_goldens(golden);
+    if (checks && !golden.update)
+        failures += run_checks();
+    if (failures > 0)
+    {
+        std::cout << failures << " failed" << std::endl;
+        return 1;
+    }
+    std::cout << "all passed" << std::endl;
+    return 0;
+}
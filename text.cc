@@ -1,18 +1,24 @@
 #include "graphics.h"
 #include <cmath>
 #include <iostream>
+#include <string>
 
 
-void text()
-{
-    using namespace graphics2;
+namespace {
 
     const auto HEIGHT = 200.0;
     const auto WIDTH = 400.0;
     const auto FONT_SIZE = 64.0;
-    const auto text_origin = pos_t(50.0, (HEIGHT / 2.0) + (FONT_SIZE / 2.0));
+    const auto text_origin = graphics2::pos_t(50.0, (HEIGHT / 2.0) + (FONT_SIZE / 2.0));
+
+}
+
+
+// a toy font over a marker at its origin and a row of small labels
+void text_scene(graphics2::surface_t& surface)
+{
+    using namespace graphics2;
 
-    image_surface_t surface(Format::FORMAT_ARGB32, WIDTH, HEIGHT);
     surface.fill(color_t(1, 1, 1));
     surface.fill(
         color_t(0, 1, 0, 0.5),
@@ -29,5 +35,45 @@ void text()
         text_origin,
         "graphics2!");
 
+    const font_t small(
+        toy_font_face_t("sans-serif", FontSlant::FONT_SLANT_NORMAL, FontWeight::FONT_WEIGHT_NORMAL),
+        color_t(0.2, 0.2, 0.2),
+        11);
+    for (int i = 0; i < 8; ++i)
+    {
+        surface.print(small, pos_t(10 + i * 47.3, 180), std::to_string(i * 125) + "ms");
+    }
+}
+
+
+// the scene of main: font, at the same size, printed over a marker and under
+// a faint bold toy font
+void user_font_scene(graphics2::surface_t& surface, const graphics2::font_t& font)
+{
+    using namespace graphics2;
+
+    surface.fill(color_t(1.0, 1.0, 1.0));
+    surface.fill(
+        color_t(0.0, 1.0, 0.0, 0.5),
+        arc_t(text_origin, FONT_SIZE / 4.0, 0, 2*M_PI));
+
+    surface.print(font, text_origin, "graphics2!");
+
+    surface.print(
+        font_t(
+            toy_font_face_t("Bitstream Charter", FontSlant::FONT_SLANT_NORMAL, FontWeight::FONT_WEIGHT_BOLD),
+            color_t(0.2, 0.2, 0.2, 0.3),
+            FONT_SIZE),
+        text_origin,
+        "graphics2!");
+}
+
+
+void text()
+{
+    using namespace graphics2;
+
+    image_surface_t surface(Format::FORMAT_ARGB32, WIDTH, HEIGHT);
+    text_scene(surface);
     surface.write_to_png("toy-text.png");
 }
@@ -0,0 +1,62 @@
+#include "graphics.h"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+
+namespace {
+
+    void render_scene(graphics2::image_surface_t& surface)
+    {
+        using namespace graphics2;
+        const double width = surface.width();
+        const double height = surface.height();
+        surface.fill(color_t(0.86, 0.85, 0.47));
+        auto pen = pen_t(color_t(0, 0, 0, 0.7), width / 30);
+        for (int i = 0; i < 200; ++i)
+        {
+            surface.stroke(
+                pen,
+                arc_t(
+                    pos_t(width * (i % 20) / 20.0, height * (i / 20) / 10.0),
+                    height / 20,
+                    0,
+                    2*M_PI));
+        }
+    }
+
+}
+
+
+void thumbnails()
+{
+    using namespace graphics2;
+    using clock = std::chrono::steady_clock;
+    const std::size_t levels = 4;
+
+    image_surface_t surface(Format::FORMAT_ARGB32, 2400, 1600);
+    render_scene(surface);
+
+    auto start = clock::now();
+    auto mipmaps = surface.mipmaps(levels);
+    auto mipmap_time = clock::now() - start;
+
+    start = clock::now();
+    for (const auto& level: mipmaps)
+    {
+        image_surface_t rerendered(Format::FORMAT_ARGB32, level.width(), level.height());
+        render_scene(rerendered);
+    }
+    auto render_time = clock::now() - start;
+
+    for (std::size_t level = 0; level < mipmaps.size(); ++level)
+    {
+        auto filename = "thumbnail" + std::to_string(level + 1) + ".png";
+        mipmaps[level].write_to_png(filename);
+        std::cout << "Wrote png file \"" << filename << "\"" << std::endl;
+    }
+
+    using ms = std::chrono::duration<double, std::milli>;
+    std::cout << "mipmaps: " << ms(mipmap_time).count() << " ms, "
+              << "re-rendering: " << ms(render_time).count() << " ms" << std::endl;
+}
@@ -0,0 +1,72 @@
+#include "graphics.h"
+#include "pixels.h"
+#include <cstdint>
+#include <iostream>
+
+
+// Draws into 16 bit 565 and 8 bit alpha surfaces, with cairo and with the
+// typed kernels, and checks the stored words and what pixel() reads back.
+// Returns the number of failed checks.
+int typed_surfaces()
+{
+    using namespace graphics2;
+    using rgb565 = pixel::color_bits<5, 6, 5, 0>;
+    using a8 = pixel::color_bits<0, 0, 0, 8>;
+    using argb32 = pixel::color_bits<8, 8, 8, 8>;
+
+    int failures = 0;
+    auto check = [&](bool ok, const char* what)
+    {
+        if (!ok)
+        {
+            std::cout << "typed surfaces: FAILED, " << what << std::endl;
+            ++failures;
+        }
+    };
+
+    typed_image_surface_t<rgb565> rgb(64, 48);
+    rgb.fill(rgb565(31, 0, 16, 0));
+    check(rgb.row(47)[63] == 0xf810, "565 fill stores the packed word");
+
+    // every level of each channel survives pixel()
+    bool levels = true;
+    for (unsigned level = 0; level < 64; ++level)
+    {
+        rgb.blend(rgb565(level % 32, level, 31 - level % 32, 0), int(level), 0, 1, 1);
+        const auto c = rgb.pixel(int(level), 0);
+        levels = levels && c.red().value() == level % 32 && c.green().value() == level && c.blue().value() == 31 - level % 32;
+    }
+    check(levels, "565 pixel() reads back every level");
+
+    // cairo renders straight into the 16 bit buffer
+    rgb.fill(color_t(0, 1, 0), rectangle_t(pos_t(8, 8), pos_t(16, 16)));
+    rgb.flush();
+    check(rgb.row(10)[10] == 0x07e0 && rgb.row(30)[30] == 0xf810, "cairo fills 565 pixels");
+
+    typed_image_surface_t<a8> alpha(64, 48);
+    alpha.fill(a8(0, 0, 0, 128));
+    check(alpha.row(0)[0] == 128, "A8 fill stores the alpha");
+    alpha.blend(a8(0, 0, 0, 128), 0, 0, 32, 48);
+    check(alpha.row(0)[0] == 192 && alpha.row(0)[40] == 128, "A8 blend composites over");
+    check(alpha.pixel(0, 0).alpha().value() == 192, "A8 pixel() reads the alpha");
+    alpha.fill(color_t(0, 0, 0, 1), rectangle_t(pos_t(40, 20), pos_t(8, 8)));
+    alpha.flush();
+    check(alpha.row(24)[44] == 255, "cairo fills A8 pixels");
+
+    // both into ARGB32 to look at
+    typed_image_surface_t<argb32> from_rgb(64, 48);
+    typed_image_surface_t<argb32> from_alpha(64, 48);
+    rgb.convert_to(from_rgb);
+    alpha.convert_to(from_alpha);
+    check(from_rgb.row(10)[10] == 0xff00ff00u && from_rgb.row(30)[30] == 0xffff0084u, "565 converts to ARGB32");
+    check(from_alpha.row(0)[0] == 0xc0000000u, "A8 converts to ARGB32");
+
+    image_surface_t sheet(Format::FORMAT_ARGB32, 136, 48);
+    sheet.fill(color_t(1, 1, 1));
+    sheet.draw_image(from_rgb, pos_t(0, 0), 64, 48);
+    sheet.draw_image(from_alpha, pos_t(72, 0), 64, 48);
+    std::string filename = "typed.png";
+    sheet.write_to_png(filename);
+    std::cout << "typed surfaces: " << failures << " failed, wrote \"" << filename << "\"" << std::endl;
+    return failures;
+}